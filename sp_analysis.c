@@ -0,0 +1,378 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sp_core.h"
+#include "sp_analysis.h"
+#include "sp_level.h"
+#include "sp_simd.h"
+
+// FFTW's planner is not thread safe, only executing plans is
+static pthread_mutex_t planner_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Upper bound in seconds for measuring plans, FFTW_PATIENT on the largest
+// sizes can take much longer than that otherwise
+#define SP_PLANNER_TIMELIMIT 10.0
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+// zeroth order modified Bessel function of the first kind
+static double
+bessel_i0 (double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+double
+sp_analysis_kaiser (double r, double beta)
+{
+    double x = 1.0 - r * r;
+    return bessel_i0 (beta * sqrt (x > 0 ? x : 0)) / bessel_i0 (beta);
+}
+
+static double
+window_value (int type, int i, int n)
+{
+    double x = 2 * M_PI * i / n;
+    switch (type) {
+    case SP_WINDOW_HANN:
+        return 0.5 - 0.5 * cos (x);
+    case SP_WINDOW_KAISER:
+        return sp_analysis_kaiser (2.0 * i / n - 1.0, 8.6);
+    case SP_WINDOW_FLAT_TOP:
+        return 0.21557895 - 0.41663158 * cos (x) + 0.277263158 * cos (2 * x) - 0.083578947 * cos (3 * x) + 0.006947368 * cos (4 * x);
+    case SP_WINDOW_BLACKMAN_HARRIS:
+    default:
+        return 0.35875 - 0.48829 * cos (x) + 0.14128 * cos (2 * x) - 0.01168 * cos (3 * x);
+    }
+}
+
+sp_analysis_t *
+sp_analysis_new (int fft_size, int levels, int window_type, unsigned flags)
+{
+    sp_analysis_t *a = malloc (sizeof (sp_analysis_t));
+    if (!a) {
+        return NULL;
+    }
+    memset (a, 0, sizeof (sp_analysis_t));
+    if (levels > sp_pyramid_levels (fft_size)) {
+        levels = sp_pyramid_levels (fft_size);
+    }
+    if (levels < 1) {
+        levels = 1;
+    }
+    const int size = fft_size >> (levels - 1);
+    a->fft_size = fft_size;
+    a->size = size;
+    a->levels = levels;
+    a->window_type = window_type;
+
+    a->window = malloc (sizeof (sp_sample_t) * size);
+    a->in_complex[0] = sp_fft_malloc (sizeof (sp_fft_complex) * size);
+    a->out_complex[0] = sp_fft_malloc (sizeof (sp_fft_complex) * size);
+    if (!a->window || !a->in_complex[0] || !a->out_complex[0]) {
+        sp_analysis_free (a);
+        return NULL;
+    }
+    memset (a->in_complex[0], 0, sizeof (sp_fft_complex) * size);
+
+    // A sine's peak bin scales with the window sum, keep its level (and
+    // therefore the colors) independent of FFT size and window type. The
+    // half-band filters have unity gain, so this holds on every level.
+    double sum = 0;
+    for (int i = 0; i < size; i++) {
+        a->window[i] = window_value (window_type, i, size);
+        sum += a->window[i];
+    }
+    double ref = 0.35875 * SP_DEFAULT_FFT_SIZE;
+    a->power_scale = (ref / sum) * (ref / sum);
+
+    // measuring overwrites the arrays, which are still private at this point
+    pthread_mutex_lock (&planner_mutex);
+    sp_fft_set_timelimit (SP_PLANNER_TIMELIMIT);
+    a->p_c2c = sp_fft_plan_dft_1d (size, a->in_complex[0], a->out_complex[0], FFTW_FORWARD, flags);
+    sp_fft_set_timelimit (FFTW_NO_TIMELIMIT);
+    pthread_mutex_unlock (&planner_mutex);
+    if (!a->p_c2c || !sp_analysis_reserve (a, 2)) {
+        sp_analysis_free (a);
+        return NULL;
+    }
+    return a;
+}
+
+int
+sp_analysis_reserve (sp_analysis_t *a, int lanes)
+{
+    if (lanes < 1 || lanes > SP_MAX_CHANNELS) {
+        return 0;
+    }
+    const int n = a->size;
+    if (lanes > a->lanes) {
+        free (a->samples);
+        free (a->band);
+        a->band = NULL;
+        a->samples = calloc ((size_t)lanes * n, sizeof (sp_sample_t));
+        if (a->levels > 1) {
+            // one more for a derived lane, see sp_analysis_lanes_out
+            a->band = malloc (sizeof (sp_sample_t) * (lanes + 1) * n/2);
+        }
+        for (int p = 1; p < sp_analysis_pairs (lanes); p++) {
+            if (!a->in_complex[p]) {
+                a->in_complex[p] = sp_fft_malloc (sizeof (sp_fft_complex) * n);
+                a->out_complex[p] = sp_fft_malloc (sizeof (sp_fft_complex) * n);
+            }
+            if (!a->in_complex[p] || !a->out_complex[p]) {
+                a->lanes = 0;
+                return 0;
+            }
+        }
+        if (!a->samples || (a->levels > 1 && !a->band)) {
+            a->lanes = 0;
+            return 0;
+        }
+        a->lanes = lanes;
+    }
+    if (a->levels > 1 && a->pyramid.channels != lanes) {
+        sp_pyramid_free (&a->pyramid);
+        if (sp_pyramid_init (&a->pyramid, a->levels, n, a->fft_size, lanes) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+sp_analysis_load_wisdom (const char *path)
+{
+    pthread_mutex_lock (&planner_mutex);
+    int res = sp_fft_import_wisdom_from_filename (path);
+    pthread_mutex_unlock (&planner_mutex);
+    return res;
+}
+
+int
+sp_analysis_save_wisdom (const char *path)
+{
+    // write next to the old file and rename, so that concurrent readers
+    // never see a partial file
+    size_t len = strlen (path) + 5;
+    char *tmp = malloc (len);
+    if (!tmp) {
+        return 0;
+    }
+    snprintf (tmp, len, "%s.tmp", path);
+
+    pthread_mutex_lock (&planner_mutex);
+    int res = sp_fft_export_wisdom_to_filename (tmp);
+    pthread_mutex_unlock (&planner_mutex);
+    if (res) {
+        res = rename (tmp, path) == 0;
+    }
+    if (!res) {
+        unlink (tmp);
+    }
+    free (tmp);
+    return res;
+}
+
+void
+sp_analysis_free (sp_analysis_t *a)
+{
+    if (!a) {
+        return;
+    }
+    if (a->p_c2c) {
+        pthread_mutex_lock (&planner_mutex);
+        sp_fft_destroy_plan (a->p_c2c);
+        pthread_mutex_unlock (&planner_mutex);
+    }
+    for (int p = 0; p < SP_ANALYSIS_PAIRS; p++) {
+        if (a->in_complex[p]) {
+            sp_fft_free (a->in_complex[p]);
+        }
+        if (a->out_complex[p]) {
+            sp_fft_free (a->out_complex[p]);
+        }
+    }
+    sp_pyramid_free (&a->pyramid);
+    free (a->window);
+    free (a->samples);
+    free (a->band);
+    free (a);
+}
+
+// Correlation lane: +1 (both channels in phase) at full scale, every step
+// of 1 towards -1 (opposite phase) 30 dB below it
+#define SP_CORRELATION_DB 30.0
+
+// Transform two lanes with a single complex FFT of z = l + i*r.
+// Since l and r are real, their spectra follow from the symmetry of Z:
+//   L[k] = (Z[k] + conj(Z[N-k])) / 2
+//   R[k] = (Z[k] - conj(Z[N-k])) / 2i
+// and so do all other linear combinations, like M = (L+R)/2 and
+// S = (L-R)/2, as well as the cross spectrum L*conj(R). A lone last lane
+// is transformed on its own, Z = L. Writes size/2 power values per lane to
+// power + lane*size/2; a derived lane goes after the last one.
+static void
+run_pair (sp_analysis_t *a, int pair, int lanes, int mode, sp_sample_t *power)
+{
+    const int n = a->size;
+    const int lane = 2 * pair;
+    sp_fft_complex *in = a->in_complex[pair];
+    sp_fft_complex *out = a->out_complex[pair];
+    const sp_sample_t *x0 = a->samples + (size_t)lane * n;
+    const sp_sample_t *x1 = x0 + n;
+    sp_sample_t *left = power + (size_t)lane * (n/2);
+    sp_sample_t *right = left + n/2;
+
+    if (lane + 1 >= lanes) {
+        sp_simd_window_complex (x0, NULL, a->window, in, n);
+        sp_fft_execute_dft (a->p_c2c, in, out);
+        const sp_sample_t scale = a->power_scale;
+        for (int k = 0; k < n/2; k++) {
+            left[k] = scale * (out[k][0]*out[k][0] + out[k][1]*out[k][1]);
+        }
+        return;
+    }
+
+    sp_simd_window_complex (x0, x1, a->window, in, n);
+
+    sp_fft_execute_dft (a->p_c2c, in, out);
+
+    // only the first pair is a stereo pair
+    if (pair > 0) {
+        mode = SP_LANES_LR;
+    }
+    const sp_sample_t scale = 0.25f * a->power_scale;
+    switch (mode) {
+    case SP_LANES_MS:
+        // 2L = sum_re + i*sum_im, 2R = dif_im - i*dif_re
+        for (int k = 0; k < n/2; k++) {
+            int nk = (n - k) & (n - 1);
+            sp_sample_t sum_re = out[k][0] + out[nk][0];
+            sp_sample_t sum_im = out[k][1] - out[nk][1];
+            sp_sample_t dif_re = out[k][0] - out[nk][0];
+            sp_sample_t dif_im = out[k][1] + out[nk][1];
+            sp_sample_t mid_re = sum_re + dif_im, mid_im = sum_im - dif_re;
+            sp_sample_t side_re = sum_re - dif_im, side_im = sum_im + dif_re;
+            left[k] = 0.25f * scale * (mid_re*mid_re + mid_im*mid_im);
+            right[k] = 0.25f * scale * (side_re*side_re + side_im*side_im);
+        }
+        break;
+    case SP_LANES_LR_CORRELATION: {
+        // cos of the phase difference, Re (L*conj(R)) / (|L|*|R|), shown
+        // no brighter than the quieter channel so silence stays dark
+        sp_sample_t *corr = power + (size_t)lanes * (n/2);
+        const double full_scale = pow (10, SP_LEVEL_FULL_SCALE / 10.0);
+        const double k_db = -SP_CORRELATION_DB / 10.0 * M_LN10;
+        for (int k = 0; k < n/2; k++) {
+            int nk = (n - k) & (n - 1);
+            sp_sample_t sum_re = out[k][0] + out[nk][0];
+            sp_sample_t sum_im = out[k][1] - out[nk][1];
+            sp_sample_t dif_re = out[k][0] - out[nk][0];
+            sp_sample_t dif_im = out[k][1] + out[nk][1];
+            sp_sample_t pl = sum_re*sum_re + sum_im*sum_im;
+            sp_sample_t pr = dif_re*dif_re + dif_im*dif_im;
+            left[k] = scale * pl;
+            right[k] = scale * pr;
+            sp_sample_t c = 0;
+            if (pl > 0 && pr > 0) {
+                double rho = (sum_re*dif_im - sum_im*dif_re) / sqrt ((double)pl * pr);
+                c = (sp_sample_t)(full_scale * exp (k_db * (1 - rho)));
+                c = MIN (c, MIN (left[k], right[k]));
+            }
+            corr[k] = c;
+        }
+        break;
+    }
+    default:
+        for (int k = 0; k < n/2; k++) {
+            int nk = (n - k) & (n - 1);
+            sp_sample_t sum_re = out[k][0] + out[nk][0];
+            sp_sample_t sum_im = out[k][1] - out[nk][1];
+            sp_sample_t dif_re = out[k][0] - out[nk][0];
+            sp_sample_t dif_im = out[k][1] + out[nk][1];
+            left[k] = scale * (sum_re*sum_re + sum_im*sum_im);
+            right[k] = scale * (dif_re*dif_re + dif_im*dif_im);
+        }
+        break;
+    }
+}
+
+void
+sp_analysis_run (sp_analysis_t *a, int pair, int lanes, int mode, sp_sample_t *out)
+{
+    run_pair (a, pair, lanes, mode, out);
+}
+
+int
+sp_analysis_latency (const sp_analysis_t *a)
+{
+    return a->levels > 1 ? a->pyramid.latency : 0;
+}
+
+// Level l covers the octave below its Nyquist frequency down to where the
+// next level takes over, at 3/4 of that one's Nyquist frequency, which is
+// still inside the alias free part of the half-band filter. The last level
+// goes down to DC. Its bins are repeated to the resolution of the last
+// level, so the column looks like the output of one fft_size point FFT.
+void
+sp_analysis_run_pyramid (sp_analysis_t *a, int pair, int lanes, int mode, uint64_t center, sp_sample_t *out)
+{
+    const int bins = a->fft_size / 2;
+    const int last = MIN (2 * pair + 2, lanes);
+    const int derived = pair == 0 && sp_analysis_lanes_out (lanes, mode) > lanes;
+    int hi = bins;
+    for (int l = 0; l < a->levels; l++) {
+        const int shift = a->levels - 1 - l;
+        const int lo = l < a->levels - 1 ? 3 * (bins >> (l + 1)) / 4 : 0;
+        for (int lane = 2 * pair; lane < last; lane++) {
+            sp_pyramid_read (&a->pyramid, l, lane, center, a->samples + (size_t)lane * a->size);
+        }
+        run_pair (a, pair, lanes, mode, a->band);
+        for (int lane = 2 * pair; lane < last + derived; lane++) {
+            // the derived lane is at index lanes
+            const int i = lane < last ? lane : lanes;
+            const sp_sample_t *band = a->band + (size_t)i * (a->size/2);
+            sp_sample_t *dst = out + (size_t)i * bins;
+            for (int k = lo; k < hi; k++) {
+                dst[k] = band[k >> shift];
+            }
+        }
+        hi = lo;
+    }
+}
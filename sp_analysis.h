@@ -0,0 +1,127 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Analysis setup for one FFT size / window combination: window table,
+    per lane scratch buffers and the FFT plan, which transforms two lanes at
+    once packed into one complex FFT. Instances are built off the analysis
+    thread and swapped in as a whole when the configuration changes or a
+    better plan becomes available.
+
+    With more than one level the window is analyzed as an octave pyramid
+    (sp_pyramid.h): the same short FFT runs on every level and the bands
+    are stitched into a column with the resolution of the last level.
+*/
+
+#ifndef __SP_ANALYSIS_H
+#define __SP_ANALYSIS_H
+
+#include "sp_core.h"
+#include "sp_fft.h"
+#include "sp_pyramid.h"
+
+#define SP_ANALYSIS_PAIRS (SP_MAX_CHANNELS/2)
+
+typedef struct {
+    // fft_size/2 bins are produced, from FFTs of size points on each level
+    int fft_size;
+    int size;
+    int levels;
+    int window_type;
+    sp_sample_t *window;
+    // normalizes levels to the default 8192 point Blackman-Harris setup
+    sp_sample_t power_scale;
+    // Lanes the buffers below are allocated for, see sp_analysis_reserve
+    int lanes;
+    // Analysis window copied out of the ring buffer, size samples per lane
+    sp_sample_t *samples;
+    // Every pair of lanes goes through one complex FFT: the even lane in
+    // the real part, the odd one in the imaginary part. A pair has buffers
+    // of its own so that pairs can be transformed concurrently; the plan
+    // is made for those of pair 0.
+    sp_fft_complex *in_complex[SP_ANALYSIS_PAIRS];
+    sp_fft_complex *out_complex[SP_ANALYSIS_PAIRS];
+    sp_fft_plan p_c2c;
+    // Octave bands, only with levels > 1: decimated input and the power
+    // of one level before it is stitched into the column, size/2 per lane
+    // and one more for a derived lane
+    sp_pyramid_t pyramid;
+    sp_sample_t *band;
+} sp_analysis_t;
+
+// flags are FFTW planner flags. Everything but FFTW_ESTIMATE may take a
+// long time and returns NULL with FFTW_WISDOM_ONLY if the plan is unknown.
+// levels is clamped to what sp_pyramid_levels allows for fft_size.
+sp_analysis_t *
+sp_analysis_new (int fft_size, int levels, int window_type, unsigned flags);
+
+void
+sp_analysis_free (sp_analysis_t *a);
+
+// Size the buffers (and the pyramid) for lanes channels. Starts the
+// pyramid over if the number changes. Returns 0 if out of memory.
+int
+sp_analysis_reserve (sp_analysis_t *a, int lanes);
+
+// Number of FFTs, i.e. pairs, for lanes channels
+static inline int
+sp_analysis_pairs (int lanes)
+{
+    return (lanes + 1) / 2;
+}
+
+// Lanes written for lanes channels in mode (SP_LANES_*): the correlation
+// lane is added after the others
+static inline int
+sp_analysis_lanes_out (int lanes, int mode)
+{
+    return lanes + (lanes >= 2 && mode == SP_LANES_LR_CORRELATION);
+}
+
+// Window the samples of lanes 2*pair and 2*pair+1 (the latter only if it
+// is below lanes) and write fft_size/2 power values per lane to out, lane
+// i at out + i*fft_size/2. Pair 0 turns the first two lanes into the ones
+// mode asks for. Single level setups only. Different pairs may run
+// concurrently.
+void
+sp_analysis_run (sp_analysis_t *a, int pair, int lanes, int mode, sp_sample_t *out);
+
+// Same for a pyramid fed past the window of fft_size input frames
+// centered on frame center, see sp_analysis_latency
+void
+sp_analysis_run_pyramid (sp_analysis_t *a, int pair, int lanes, int mode, uint64_t center, sp_sample_t *out);
+
+// Input frames past the end of a window that have to be fed to the pyramid
+// before it can be analyzed, 0 for a single level
+int
+sp_analysis_latency (const sp_analysis_t *a);
+
+// Kaiser window at r = -1 .. 1, also used for filter design
+double
+sp_analysis_kaiser (double r, double beta);
+
+// Process wide FFTW wisdom, serialized with plan creation
+int
+sp_analysis_load_wisdom (const char *path);
+
+int
+sp_analysis_save_wisdom (const char *path);
+
+#endif // __SP_ANALYSIS_H
@@ -0,0 +1,440 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sp_cache.h"
+#include "sp_fifo.h"
+#include "sp_level.h"
+
+#define SP_CACHE_MAGIC "SPCACHE"
+#define SP_CACHE_HEADER_SIZE 4096
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t tile_columns;
+    uint32_t bins;
+    uint32_t fft_size;
+    uint32_t hop;
+    uint32_t samplerate;
+    uint32_t channels;
+    uint64_t columns;
+    uint64_t key;
+} sp_cache_header_t;
+
+// One mapped file
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    uint64_t *valid;
+    uint8_t *tiles;
+    sp_cache_params_t params;
+    int bins;
+} sp_cache_map_t;
+
+typedef struct {
+    int64_t column;
+    unsigned generation;
+    uint8_t data[SP_MAX_LANES*SP_CACHE_MAX_BINS];
+} sp_cache_item_t;
+
+struct sp_cache_s {
+    char *dir;
+    // Columns on their way from the producer to the writer
+    sp_cache_item_t items[SP_CACHE_QUEUE];
+    sp_fifo_t fifo;
+    // Producer side layout of the selected file
+    int bins;
+    int group;
+    int channels;
+    int64_t columns;
+    // Writer thread; generation counts selections and tags queued columns
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int stop;
+    int select_pending;
+    sp_cache_params_t select;
+    unsigned generation;
+    // File in use, only replaced by the writer while holding the write lock
+    pthread_rwlock_t map_lock;
+    sp_cache_map_t map;
+    unsigned map_generation;
+};
+
+uint64_t
+sp_cache_hash (uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    if (!hash) {
+        hash = 0xcbf29ce484222325ULL;
+    }
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Stored bins per lane and file size for params, 0 if they can't be cached
+static size_t
+cache_layout (const sp_cache_params_t *p, int *bins, int *group)
+{
+    if (p->columns <= 0 || p->fft_size < 2 || p->hop <= 0 || p->samplerate <= 0
+            || p->channels < 1 || p->channels > SP_MAX_LANES) {
+        return 0;
+    }
+    *bins = p->fft_size / 2;
+    *group = 1;
+    while (*bins > SP_CACHE_MAX_BINS) {
+        *bins /= 2;
+        *group *= 2;
+    }
+    uint64_t tiles = (p->columns + SP_CACHE_TILE - 1) / SP_CACHE_TILE;
+    uint64_t valid = (tiles * sizeof (uint64_t) + SP_CACHE_HEADER_SIZE - 1) & ~(uint64_t)(SP_CACHE_HEADER_SIZE - 1);
+    uint64_t size = SP_CACHE_HEADER_SIZE + valid + tiles * SP_CACHE_TILE * p->channels * *bins;
+    // very long tracks would evict everything else
+    if (size > SP_CACHE_MAX_DISK) {
+        return 0;
+    }
+    return (size_t)size;
+}
+
+typedef struct {
+    char name[32];
+    time_t mtime;
+    long long bytes;
+} sp_cache_file_t;
+
+static int
+compare_mtime (const void *a, const void *b)
+{
+    const sp_cache_file_t *fa = a, *fb = b;
+    return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+// Remove the least recently written files until the directory fits into
+// SP_CACHE_MAX_DISK, counting allocated blocks since the files are sparse
+static void
+cache_trim (const char *dir)
+{
+    DIR *d = opendir (dir);
+    if (!d) {
+        return;
+    }
+    sp_cache_file_t *files = NULL;
+    int n = 0, capacity = 0;
+    long long total = 0;
+    struct dirent *de;
+    while ((de = readdir (d))) {
+        size_t len = strlen (de->d_name);
+        if (len < 4 || len >= sizeof (files->name) || strcmp (de->d_name + len - 4, ".spc")) {
+            continue;
+        }
+        if (n == capacity) {
+            sp_cache_file_t *f = realloc (files, (capacity ? capacity * 2 : 64) * sizeof (sp_cache_file_t));
+            if (!f) {
+                break;
+            }
+            files = f;
+            capacity = capacity ? capacity * 2 : 64;
+        }
+        char path[4096];
+        struct stat st;
+        snprintf (path, sizeof (path), "%s/%s", dir, de->d_name);
+        if (stat (path, &st) == 0) {
+            memcpy (files[n].name, de->d_name, len + 1);
+            files[n].mtime = st.st_mtime;
+            files[n].bytes = (long long)st.st_blocks * 512;
+            total += files[n].bytes;
+            n++;
+        }
+    }
+    closedir (d);
+
+    if (total > SP_CACHE_MAX_DISK) {
+        qsort (files, n, sizeof (sp_cache_file_t), compare_mtime);
+        for (int i = 0; i < n && total > SP_CACHE_MAX_DISK; i++) {
+            char path[4096];
+            snprintf (path, sizeof (path), "%s/%s", dir, files[i].name);
+            if (unlink (path) == 0) {
+                total -= files[i].bytes;
+            }
+        }
+    }
+    free (files);
+}
+
+// Map the file for params, creating or resetting it if its layout does not
+// match. Returns 1 if the file was created.
+static int
+map_open (sp_cache_map_t *m, const char *dir, const sp_cache_params_t *p)
+{
+    int bins, group;
+    size_t size = cache_layout (p, &bins, &group);
+    if (!size) {
+        return 0;
+    }
+    char path[4096];
+    snprintf (path, sizeof (path), "%s/%016llx.spc", dir, (unsigned long long)p->key);
+    int fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    int fresh = fstat (fd, &st) != 0 || (size_t)st.st_size != size;
+    if (fresh && (ftruncate (fd, 0) != 0 || ftruncate (fd, size) != 0)) {
+        close (fd);
+        return 0;
+    }
+    uint8_t *base = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // keeps recently played tracks out of cache_trim
+    futimens (fd, NULL);
+    close (fd);
+    if (base == MAP_FAILED) {
+        return 0;
+    }
+
+    sp_cache_header_t header;
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, SP_CACHE_MAGIC, sizeof (header.magic));
+    header.version = SP_CACHE_VERSION;
+    header.tile_columns = SP_CACHE_TILE;
+    header.bins = bins;
+    header.fft_size = p->fft_size;
+    header.hop = p->hop;
+    header.samplerate = p->samplerate;
+    header.channels = p->channels;
+    header.columns = p->columns;
+    header.key = p->key;
+
+    m->base = base;
+    m->size = size;
+    m->valid = (uint64_t *)(base + SP_CACHE_HEADER_SIZE);
+    m->tiles = base + size - (size_t)((p->columns + SP_CACHE_TILE - 1) / SP_CACHE_TILE) * SP_CACHE_TILE * p->channels * bins;
+    m->params = *p;
+    m->bins = bins;
+    if (memcmp (base, &header, sizeof (header)) != 0) {
+        // other version or a hash collision, start over
+        memset (m->valid, 0, m->tiles - (uint8_t *)m->valid);
+        memcpy (base, &header, sizeof (header));
+    }
+    return fresh;
+}
+
+static void
+cache_switch (sp_cache_t *c, const sp_cache_params_t *params, unsigned generation)
+{
+    sp_cache_map_t m;
+    memset (&m, 0, sizeof (m));
+    if (map_open (&m, c->dir, params)) {
+        cache_trim (c->dir);
+    }
+
+    pthread_rwlock_wrlock (&c->map_lock);
+    sp_cache_map_t old = c->map;
+    c->map = m;
+    pthread_rwlock_unlock (&c->map_lock);
+    c->map_generation = generation;
+    if (old.base) {
+        munmap (old.base, old.size);
+    }
+}
+
+static void
+cache_store (sp_cache_t *c, const sp_cache_item_t *item)
+{
+    sp_cache_map_t *m = &c->map;
+    if (!m->base || item->generation != c->map_generation || item->column >= m->params.columns) {
+        return;
+    }
+    const size_t stride = (size_t)m->params.channels * m->bins;
+    memcpy (m->tiles + item->column * stride, item->data, stride);
+    __atomic_fetch_or (&m->valid[item->column / SP_CACHE_TILE], 1ULL << (item->column % SP_CACHE_TILE), __ATOMIC_RELEASE);
+}
+
+static void *
+cache_writer_thread (void *ctx)
+{
+    sp_cache_t *c = ctx;
+
+    pthread_mutex_lock (&c->mutex);
+    for (;;) {
+        while (!c->stop && !c->select_pending && !sp_fifo_pending (&c->fifo)) {
+            pthread_cond_wait (&c->cond, &c->mutex);
+        }
+        if (c->stop) {
+            break;
+        }
+        if (c->select_pending) {
+            sp_cache_params_t params = c->select;
+            unsigned generation = c->generation;
+            c->select_pending = 0;
+            pthread_mutex_unlock (&c->mutex);
+            cache_switch (c, &params, generation);
+            pthread_mutex_lock (&c->mutex);
+            continue;
+        }
+        pthread_mutex_unlock (&c->mutex);
+        int slot;
+        while ((slot = sp_fifo_read_slot (&c->fifo)) >= 0) {
+            cache_store (c, &c->items[slot]);
+            sp_fifo_release (&c->fifo, 1);
+        }
+        pthread_mutex_lock (&c->mutex);
+    }
+    pthread_mutex_unlock (&c->mutex);
+    return NULL;
+}
+
+sp_cache_t *
+sp_cache_new (const char *dir)
+{
+    if (mkdir (dir, 0755) != 0 && access (dir, W_OK) != 0) {
+        return NULL;
+    }
+    sp_cache_t *c = malloc (sizeof (sp_cache_t));
+    if (!c) {
+        return NULL;
+    }
+    memset (c, 0, sizeof (sp_cache_t));
+    c->dir = strdup (dir);
+    sp_fifo_init (&c->fifo, SP_CACHE_QUEUE);
+    pthread_mutex_init (&c->mutex, NULL);
+    pthread_cond_init (&c->cond, NULL);
+    pthread_rwlock_init (&c->map_lock, NULL);
+    if (!c->dir || pthread_create (&c->writer, NULL, cache_writer_thread, c) != 0) {
+        pthread_rwlock_destroy (&c->map_lock);
+        pthread_cond_destroy (&c->cond);
+        pthread_mutex_destroy (&c->mutex);
+        free (c->dir);
+        free (c);
+        return NULL;
+    }
+    return c;
+}
+
+void
+sp_cache_free (sp_cache_t *c)
+{
+    if (!c) {
+        return;
+    }
+    pthread_mutex_lock (&c->mutex);
+    c->stop = 1;
+    pthread_cond_signal (&c->cond);
+    pthread_mutex_unlock (&c->mutex);
+    pthread_join (c->writer, NULL);
+
+    if (c->map.base) {
+        munmap (c->map.base, c->map.size);
+    }
+    pthread_rwlock_destroy (&c->map_lock);
+    pthread_cond_destroy (&c->cond);
+    pthread_mutex_destroy (&c->mutex);
+    free (c->dir);
+    free (c);
+}
+
+void
+sp_cache_select (sp_cache_t *c, const sp_cache_params_t *params)
+{
+    sp_cache_params_t none;
+    memset (&none, 0, sizeof (none));
+    if (!params || !cache_layout (params, &c->bins, &c->group)) {
+        params = &none;
+        c->bins = 0;
+    }
+    c->columns = params->columns;
+    c->channels = params->channels;
+
+    pthread_mutex_lock (&c->mutex);
+    c->generation++;
+    c->select = *params;
+    c->select_pending = 1;
+    pthread_cond_signal (&c->cond);
+    pthread_mutex_unlock (&c->mutex);
+}
+
+void
+sp_cache_put (sp_cache_t *c, int64_t column, const sp_sample_t *data)
+{
+    if (!c->bins || column < 0 || column >= c->columns) {
+        return;
+    }
+    int slot = sp_fifo_write_slot (&c->fifo);
+    if (slot < 0) {
+        return;
+    }
+    sp_cache_item_t *item = &c->items[slot];
+    item->column = column;
+    item->generation = c->generation;
+    for (int i = 0; i < c->channels; i++) {
+        sp_level_quantize (data + (size_t)i * c->bins * c->group, item->data + i * c->bins, c->bins, c->group);
+    }
+    sp_fifo_commit (&c->fifo);
+
+    // wake up the writer, unless it is busy anyway
+    if (pthread_mutex_trylock (&c->mutex) == 0) {
+        pthread_cond_signal (&c->cond);
+        pthread_mutex_unlock (&c->mutex);
+    }
+}
+
+void
+sp_cache_pin (sp_cache_t *c)
+{
+    pthread_rwlock_rdlock (&c->map_lock);
+}
+
+void
+sp_cache_unpin (sp_cache_t *c)
+{
+    pthread_rwlock_unlock (&c->map_lock);
+}
+
+const uint8_t *
+sp_cache_get (sp_cache_t *c, double time, int back, int *bins, int *samplerate, int *channels)
+{
+    const sp_cache_map_t *m = &c->map;
+    if (!m->base || time < 0) {
+        return NULL;
+    }
+    int64_t column = (int64_t)floor (time * m->params.samplerate / m->params.hop) - back;
+    if (column < 0 || column >= m->params.columns
+            || !(__atomic_load_n (&m->valid[column / SP_CACHE_TILE], __ATOMIC_ACQUIRE) >> (column % SP_CACHE_TILE) & 1)) {
+        return NULL;
+    }
+    *bins = m->bins;
+    *samplerate = m->params.samplerate;
+    *channels = m->params.channels;
+    return m->tiles + column * m->params.channels * m->bins;
+}
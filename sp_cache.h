@@ -0,0 +1,107 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Per track cache of analyzed columns, one memory mapped file per track
+    and analysis setup:
+
+      header    one page, see sp_cache_header_t
+      valid     one 64 bit mask per tile, bit i is set once column
+                tile*64+i has been stored
+      tiles     64 columns each; per column one lane after the other,
+                one byte per bin (sp_level.h)
+
+    Files are created at full size but only written where columns arrive,
+    so they stay sparse on disk. Lookups read straight from the mapping.
+    Stores are queued and done by a writer thread, which also opens and
+    maps the file whenever another one is selected, so neither the
+    analysis nor the UI side ever waits for the disk.
+*/
+
+#ifndef __SP_CACHE_H
+#define __SP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sp_core.h"
+#include "sp_fft.h"
+
+#define SP_CACHE_VERSION 2
+#define SP_CACHE_TILE 64
+// Higher resolutions are max-reduced to this many bins per lane
+#define SP_CACHE_MAX_BINS 2048
+// Columns queued for the writer
+#define SP_CACHE_QUEUE 64
+// Least recently written files are removed beyond this
+#define SP_CACHE_MAX_DISK (512LL << 20)
+
+typedef struct sp_cache_s sp_cache_t;
+
+typedef struct {
+    // identifies the track together with the analysis setup, the file name
+    uint64_t key;
+    int fft_size;
+    int hop;
+    int samplerate;
+    int channels;   // lanes per column
+    int64_t columns;
+} sp_cache_params_t;
+
+// Files are kept in dir, which is created if needed
+sp_cache_t *
+sp_cache_new (const char *dir);
+
+void
+sp_cache_free (sp_cache_t *c);
+
+// Switch to the file for params, NULL for none. Takes effect once the
+// writer has mapped it, columns put before that are dropped. Only called
+// by the single producer, like sp_cache_put.
+void
+sp_cache_select (sp_cache_t *c, const sp_cache_params_t *params);
+
+// Quantize and queue column of the selected file, fft_size/2 power values
+// per lane, lane i at data + i*fft_size/2. Never blocks, drops the column if
+// the writer falls behind.
+void
+sp_cache_put (sp_cache_t *c, int64_t column, const sp_sample_t *data);
+
+// Keep the mapped file in place for sp_cache_get until sp_cache_unpin.
+// Selecting another file waits meanwhile, so pin only around a batch of
+// lookups.
+void
+sp_cache_pin (sp_cache_t *c);
+
+void
+sp_cache_unpin (sp_cache_t *c);
+
+// Levels (sp_level.h) of the column back hops before the one at time
+// (seconds), read straight from the mapping: bins per lane, lane i at
+// levels + i * *bins. Only valid while the cache is pinned. NULL if the
+// column is not cached.
+const uint8_t *
+sp_cache_get (sp_cache_t *c, double time, int back, int *bins, int *samplerate, int *channels);
+
+// FNV-1a, for building keys
+uint64_t
+sp_cache_hash (uint64_t hash, const void *data, size_t len);
+
+#endif // __SP_CACHE_H
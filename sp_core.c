@@ -0,0 +1,1608 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sp_core.h"
+#include "sp_fft.h"
+#include "sp_analysis.h"
+#include "sp_cache.h"
+#include "sp_decimator.h"
+#include "sp_history.h"
+#include "sp_level.h"
+#include "sp_pool.h"
+#include "sp_ringbuf.h"
+#include "sp_fifo.h"
+#include "sp_rowmap.h"
+#include "sp_simd.h"
+#include "sp_stats.h"
+#include "fastftoi.h"
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef CLAMP
+#define CLAMP(x,lo,hi) (((x) > (hi)) ? (hi) : (((x) < (lo)) ? (lo) : (x)))
+#endif
+
+// Helper threads for the channel FFTs at most, besides the analysis thread
+#define SP_POOL_THREADS (SP_ANALYSIS_PAIRS - 1)
+// Smaller windows are analyzed on one thread, waking up the pool would take
+// longer than the FFTs
+#define SP_POOL_MIN_SIZE 4096
+
+// One finished analysis result, power per FFT bin for each lane in turn
+typedef struct {
+    sp_sample_t *data;
+    int lanes;
+    int mode;     // SP_LANES_* the lanes were derived with
+    int capacity; // allocated values
+    int fft_size;
+    float samplerate;
+} sp_spectrum_t;
+
+// Track announced by sp_core_set_track, key 0 for none
+typedef struct {
+    uint64_t key;
+    double duration;
+} sp_track_t;
+
+// Ties the ring buffer to the track: frame of the track at ring position
+// pos. A new serial starts with every seek or track change.
+typedef struct {
+    uint64_t pos;
+    int64_t frame;
+    unsigned serial;
+} sp_anchor_t;
+
+struct sp_core_s {
+    // Spectra of all lanes queued from the analysis side to the renderer,
+    // one per hop
+    sp_spectrum_t spectra[SP_SPECTRUM_QUEUE];
+    sp_fifo_t fifo;
+    // Result of sp_core_render_frames, which bypasses the queue
+    sp_spectrum_t offline;
+    uint32_t colors[GRADIENT_TABLE_SIZE];
+    // Incoming audio, written by the audio thread
+    sp_ringbuf_t ring;
+    int samplerate_in;
+    int lanes_in;
+    // Audio thread: ring plane of each selected channel for the current
+    // input, set up for channel_mask (accessed atomically)
+    int channel_map[SP_MAX_CHANNELS];
+    int map_channels;
+    int map_mask;
+    int map_lanes;
+    int channel_mask;
+    // SP_LANES_* for the analysis side (accessed atomically)
+    int lane_mode;
+    // Audio thread: decimator in front of the ring, set up for this input
+    // rate and bandwidth, and its output. bandwidth is the configured one
+    // (accessed atomically).
+    sp_decimator_t decimator;
+    int decimator_rate;
+    int decimator_bandwidth;
+    float decimated[SP_MAX_CHANNELS * SP_DECIMATOR_CHUNK];
+    int bandwidth;
+    // FFT setup in use by the analysis side, and a replacement built by the
+    // builder thread waiting to be picked up (accessed atomically)
+    sp_analysis_t *analysis;
+    sp_analysis_t *analysis_next;
+    // Builder thread, (re)plans whenever request is bumped
+    pthread_t builder;
+    pthread_mutex_t builder_mutex;
+    pthread_cond_t builder_cond;
+    int builder_running;
+    int builder_stop;
+    unsigned builder_request;
+    unsigned builder_done;
+    int fft_size;
+    int pyramid_levels;
+    int window_type;
+    int planner;
+    // End of the next window to analyze, advanced by hop frames per column
+    uint64_t next_end;
+    int hop;
+    // Analysis worker
+    pthread_t worker;
+    pthread_mutex_t worker_mutex;
+    pthread_cond_t worker_cond;
+    int worker_running;
+    int worker_stop;
+    int interval;
+    // Runs the channel FFTs of one window side by side, created by the
+    // analysis side the first time there is more than one pair
+    sp_pool_t *pool;
+    int pool_tried;
+    // Set while the caller wants analysis, between sp_core_start and
+    // sp_core_stop (accessed atomically)
+    int active;
+    // Shared analysis (sp_core_follow): the cores following this one,
+    // linked through next_follower and guarded by followers_mutex, and the
+    // core this one follows
+    sp_core_t *followers;
+    sp_core_t *next_follower;
+    pthread_mutex_t followers_mutex;
+    sp_core_t *source;
+    // Render state, owned by the thread calling sp_core_render_column:
+    // row to bin mapping of the upper lanes and the bottom one, which takes
+    // the rows left over, one column of levels
+    // and their gradient indices, the scrollback and its budget as last
+    // configured (accessed atomically)
+    sp_rowmap_t rowmap[2];
+    // lanes of the column rasterized last, the rowmaps are laid out for them
+    int view_lanes;
+    float *levels;
+    int32_t *color_index;
+    int levels_capacity;
+    sp_history_t history;
+    size_t history_budget;
+    sp_config_t conf;
+    sp_stats_t stats;
+    // Per track cache, created on the first sp_core_set_track (accessed
+    // atomically). The audio thread publishes the anchor through a
+    // seqlock, the analysis side picks up the track and stores columns.
+    sp_cache_t *cache;
+    sp_track_t *track_next;
+    unsigned anchor_seq;
+    sp_anchor_t anchor;
+    // audio thread copy of the anchor
+    sp_anchor_t anchor_w;
+    int anchor_rate;
+    // analysis side: current track, the ring position it was picked up at,
+    // the anchor columns are stored for and the key of the selected file
+    sp_track_t *track;
+    uint64_t track_pos;
+    unsigned cache_serial;
+    uint64_t cache_key;
+};
+
+// FFTW wisdom file inside the cache directory, shared by all cores, and
+// the directory of the per track caches. Builder and analysis threads
+// read them while the plugin may be stopping, so they only ever take a
+// copy under cache_dir_mutex.
+static pthread_mutex_t cache_dir_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char *wisdom_path;
+static char *tracks_dir;
+
+void
+sp_core_set_cache_dir (const char *dir)
+{
+    char *wisdom = NULL, *tracks = NULL;
+    if (dir) {
+        tracks = malloc (strlen (dir) + 8);
+        if (tracks) {
+            sprintf (tracks, "%s/tracks", dir);
+        }
+        size_t len = strlen (dir) + strlen (SP_FFT_WISDOM_FILE) + 2;
+        wisdom = malloc (len);
+        if (wisdom) {
+            snprintf (wisdom, len, "%s/%s", dir, SP_FFT_WISDOM_FILE);
+            sp_analysis_load_wisdom (wisdom);
+        }
+    }
+
+    pthread_mutex_lock (&cache_dir_mutex);
+    char *old_wisdom = wisdom_path, *old_tracks = tracks_dir;
+    wisdom_path = wisdom;
+    tracks_dir = tracks;
+    pthread_mutex_unlock (&cache_dir_mutex);
+    free (old_wisdom);
+    free (old_tracks);
+}
+
+// Copy of one of the paths above, NULL if it is not set; free it
+static char *
+cache_dir_path (char *const *path)
+{
+    pthread_mutex_lock (&cache_dir_mutex);
+    char *copy = *path ? strdup (*path) : NULL;
+    pthread_mutex_unlock (&cache_dir_mutex);
+    return copy;
+}
+
+static unsigned
+planner_flags (int planner)
+{
+    switch (planner) {
+    case SP_PLANNER_PATIENT:
+        return FFTW_PATIENT;
+    case SP_PLANNER_MEASURE:
+        return FFTW_MEASURE;
+    default:
+        return FFTW_ESTIMATE;
+    }
+}
+
+// Hand a finished setup over to the analysis side, unless the configuration
+// changed while it was being built
+static void
+builder_publish (sp_core_t *s, unsigned request, sp_analysis_t *a)
+{
+    if (!a) {
+        return;
+    }
+    if (__atomic_load_n (&s->builder_request, __ATOMIC_RELAXED) != request) {
+        sp_analysis_free (a);
+        return;
+    }
+    // drop one that was never picked up
+    sp_analysis_t *prev = __atomic_exchange_n (&s->analysis_next, a, __ATOMIC_ACQ_REL);
+    sp_analysis_free (prev);
+}
+
+static void *
+analysis_builder_thread (void *ctx)
+{
+    sp_core_t *s = ctx;
+    unsigned done = 0;
+
+    pthread_mutex_lock (&s->builder_mutex);
+    for (;;) {
+        while (!s->builder_stop && s->builder_request == done) {
+            pthread_cond_wait (&s->builder_cond, &s->builder_mutex);
+        }
+        if (s->builder_stop) {
+            break;
+        }
+        unsigned request = s->builder_request;
+        int fft_size = s->fft_size;
+        int levels = s->pyramid_levels;
+        int window_type = s->window_type;
+        unsigned flags = planner_flags (s->planner);
+        pthread_mutex_unlock (&s->builder_mutex);
+
+        // Start out with a plan that is cheap to create, then replace it
+        // with a measured one. If wisdom already knows the measured plan
+        // it is just as cheap, so use it right away.
+        sp_analysis_t *a = NULL;
+        if (flags != FFTW_ESTIMATE) {
+            a = sp_analysis_new (fft_size, levels, window_type, flags | FFTW_WISDOM_ONLY);
+        }
+        if (!a) {
+            builder_publish (s, request, sp_analysis_new (fft_size, levels, window_type, FFTW_ESTIMATE));
+            if (flags != FFTW_ESTIMATE && __atomic_load_n (&s->builder_request, __ATOMIC_RELAXED) == request) {
+                a = sp_analysis_new (fft_size, levels, window_type, flags);
+                char *path = a ? cache_dir_path (&wisdom_path) : NULL;
+                if (path) {
+                    sp_analysis_save_wisdom (path);
+                    free (path);
+                }
+            }
+        }
+        builder_publish (s, request, a);
+        done = request;
+        __atomic_store_n (&s->builder_done, done, __ATOMIC_RELEASE);
+
+        pthread_mutex_lock (&s->builder_mutex);
+    }
+    pthread_mutex_unlock (&s->builder_mutex);
+    return NULL;
+}
+
+sp_core_t *
+sp_core_new (void)
+{
+    sp_core_t *s = malloc (sizeof (sp_core_t));
+    if (!s) {
+        return NULL;
+    }
+    memset (s, 0, sizeof (sp_core_t));
+
+    s->conf.log_scale = 1;
+    s->conf.db_range = 70;
+
+    if (sp_ringbuf_init (&s->ring, SP_MAX_CHANNELS, SP_RING_SIZE) < 0) {
+        free (s);
+        return NULL;
+    }
+
+    // Spectrum buffers are (re)allocated by the analysis side on demand
+    sp_fifo_init (&s->fifo, SP_SPECTRUM_QUEUE);
+    s->hop = 1024;
+    s->next_end = SP_DEFAULT_FFT_SIZE/2;
+
+    // Even an FFTW_ESTIMATE plan takes a while for large sizes and has to
+    // wait for the planner lock, so the first setup is built in the
+    // background as well; analysis starts once it arrives
+    s->fft_size = SP_DEFAULT_FFT_SIZE;
+    s->pyramid_levels = 1;
+    s->window_type = SP_WINDOW_BLACKMAN_HARRIS;
+    s->planner = SP_PLANNER_MEASURE;
+    s->builder_request = 1;
+    pthread_mutex_init (&s->builder_mutex, NULL);
+    pthread_cond_init (&s->builder_cond, NULL);
+    if (pthread_create (&s->builder, NULL, analysis_builder_thread, s) == 0) {
+        s->builder_running = 1;
+    }
+    else {
+        s->analysis = sp_analysis_new (s->fft_size, s->pyramid_levels, s->window_type, FFTW_ESTIMATE);
+    }
+
+    pthread_mutex_init (&s->worker_mutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init (&attr);
+    pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+    pthread_cond_init (&s->worker_cond, &attr);
+    pthread_condattr_destroy (&attr);
+    s->interval = 25;
+    pthread_mutex_init (&s->followers_mutex, NULL);
+
+    s->samplerate_in = 44100;
+    s->lanes_in = 2;
+    sp_decimator_setup (&s->decimator, 1);
+    sp_rowmap_init (&s->rowmap[0]);
+    sp_rowmap_init (&s->rowmap[1]);
+    sp_history_init (&s->history);
+
+    return s;
+}
+
+// Once this returns the source no longer touches the follower's queue
+static void
+followers_remove (sp_core_t *s, sp_core_t *follower)
+{
+    pthread_mutex_lock (&s->followers_mutex);
+    for (sp_core_t **f = &s->followers; *f; f = &(*f)->next_follower) {
+        if (*f == follower) {
+            *f = follower->next_follower;
+            break;
+        }
+    }
+    follower->next_follower = NULL;
+    pthread_mutex_unlock (&s->followers_mutex);
+}
+
+void
+sp_core_free (sp_core_t *s)
+{
+    if (!s) {
+        return;
+    }
+    sp_core_stop (s);
+    if (s->source) {
+        followers_remove (s->source, s);
+    }
+    sp_pool_free (s->pool);
+    sp_cache_free (s->cache);
+    free (s->track);
+    free (s->track_next);
+    if (s->builder_running) {
+        // waits for a plan that is currently being measured
+        pthread_mutex_lock (&s->builder_mutex);
+        s->builder_stop = 1;
+        pthread_cond_signal (&s->builder_cond);
+        pthread_mutex_unlock (&s->builder_mutex);
+        pthread_join (s->builder, NULL);
+    }
+
+    for (int i = 0; i < SP_SPECTRUM_QUEUE; i++) {
+        free (s->spectra[i].data);
+    }
+    free (s->offline.data);
+
+    sp_rowmap_free (&s->rowmap[0]);
+    sp_rowmap_free (&s->rowmap[1]);
+    sp_history_free (&s->history);
+    free (s->levels);
+    free (s->color_index);
+
+    sp_analysis_free (s->analysis);
+    sp_analysis_free (s->analysis_next);
+
+    sp_ringbuf_free (&s->ring);
+    pthread_cond_destroy (&s->worker_cond);
+    pthread_mutex_destroy (&s->worker_mutex);
+    pthread_cond_destroy (&s->builder_cond);
+    pthread_mutex_destroy (&s->builder_mutex);
+    pthread_mutex_destroy (&s->followers_mutex);
+    free (s);
+}
+
+void
+sp_core_set_config (sp_core_t *s, const sp_config_t *conf)
+{
+    s->conf = *conf;
+    if (conf->refresh_interval > 0) {
+        __atomic_store_n (&s->interval, conf->refresh_interval, __ATOMIC_RELAXED);
+    }
+    if (conf->hop_size > 0) {
+        __atomic_store_n (&s->hop, CLAMP (conf->hop_size, 1, SP_MAX_FFT_SIZE), __ATOMIC_RELAXED);
+    }
+    __atomic_store_n (&s->bandwidth, MAX (conf->max_bandwidth, 0), __ATOMIC_RELAXED);
+    __atomic_store_n (&s->channel_mask, conf->channel_mask, __ATOMIC_RELAXED);
+    __atomic_store_n (&s->lane_mode, CLAMP (conf->lane_mode, 0, SP_LANES_COUNT-1), __ATOMIC_RELAXED);
+    // applied by the renderer, which owns the history
+    __atomic_store_n (&s->history_budget, (size_t)MAX (conf->history_size, 0) << 20, __ATOMIC_RELAXED);
+
+    int fft_size = conf->fft_size > 0 ? CLAMP (conf->fft_size, SP_MIN_FFT_SIZE, SP_MAX_FFT_SIZE) : s->fft_size;
+    int window_type = CLAMP (conf->window, 0, SP_WINDOW_COUNT-1);
+    int planner = CLAMP (conf->planner, 0, SP_PLANNER_COUNT-1);
+    // round down to a power of two
+    while (fft_size & (fft_size - 1)) {
+        fft_size &= fft_size - 1;
+    }
+    // octave bands only pay off where the low ones get the room to show
+    // their resolution
+    int levels = conf->multires && conf->log_scale ? sp_pyramid_levels (fft_size) : 1;
+    // a follower uses the setup of its source
+    if (!s->builder_running || s->source) {
+        return;
+    }
+
+    // Rebuild plans and tables without stalling the caller or the analysis
+    pthread_mutex_lock (&s->builder_mutex);
+    if (fft_size != s->fft_size || levels != s->pyramid_levels || window_type != s->window_type || planner != s->planner) {
+        s->fft_size = fft_size;
+        s->pyramid_levels = levels;
+        s->window_type = window_type;
+        s->planner = planner;
+        __atomic_store_n (&s->builder_request, s->builder_request + 1, __ATOMIC_RELAXED);
+        pthread_cond_signal (&s->builder_cond);
+    }
+    pthread_mutex_unlock (&s->builder_mutex);
+}
+
+int
+sp_core_config_shares (const sp_config_t *a, const sp_config_t *b)
+{
+    return a->hop_size == b->hop_size
+        && a->fft_size == b->fft_size
+        && a->window == b->window
+        && a->planner == b->planner
+        && (a->multires && a->log_scale) == (b->multires && b->log_scale)
+        && a->max_bandwidth == b->max_bandwidth
+        && a->channel_mask == b->channel_mask
+        && a->lane_mode == b->lane_mode;
+}
+
+/* based on Delphi function by Witold J.Janik */
+void
+sp_core_set_gradient (sp_core_t *s, const sp_color_t *colors, int num_colors)
+{
+    num_colors -= 1;
+
+    for (int i = 0; i < GRADIENT_TABLE_SIZE; i++) {
+        double position = (double)i/GRADIENT_TABLE_SIZE;
+        /* if position > 1 then we have repetition of colors it maybe useful    */
+        if (position > 1.0) {
+            if (position - ftoi (position) == 0.0) {
+                position = 1.0;
+            }
+            else {
+                position = position - ftoi (position);
+            }
+        }
+
+        double m= num_colors * position;
+        int n=(int)m; // integer of m
+        double f=m-n;  // fraction of m
+
+        s->colors[i] = 0xFF000000;
+        float scale = 255/65535.f;
+        if (num_colors == 0) {
+            s->colors[i] = ((uint32_t)(colors[0].red*scale) & 0xFF) << 16 |
+                ((uint32_t)(colors[0].green*scale) & 0xFF) << 8 |
+                ((uint32_t)(colors[0].blue*scale) & 0xFF) << 0;
+        }
+        else if (n < num_colors) {
+            s->colors[i] = ((uint32_t)((colors[n].red*scale) + f * ((colors[n+1].red*scale)-(colors[n].red*scale))) & 0xFF) << 16 |
+                ((uint32_t)((colors[n].green*scale) + f * ((colors[n+1].green*scale)-(colors[n].green*scale))) & 0xFF) << 8 |
+                ((uint32_t)((colors[n].blue*scale) + f * ((colors[n+1].blue*scale)-(colors[n].blue*scale))) & 0xFF) << 0;
+        }
+        else if (n == num_colors) {
+            s->colors[i] = ((uint32_t)(colors[n].red*scale) & 0xFF) << 16 |
+                ((uint32_t)(colors[n].green*scale) & 0xFF) << 8 |
+                ((uint32_t)(colors[n].blue*scale) & 0xFF) << 0;
+        }
+        else {
+            s->colors[i] = 0xFFFFFFFF;
+        }
+    }
+}
+
+uint32_t
+sp_core_gradient_color (sp_core_t *s, int index)
+{
+    return s->colors[CLAMP (index, 0, GRADIENT_TABLE_SIZE-1)];
+}
+
+int
+sp_core_channel_mask (const char *list)
+{
+    int mask = 0;
+    while (*list) {
+        char *end;
+        long c = strtol (list, &end, 10);
+        if (end == list) {
+            list++;
+            continue;
+        }
+        if (c >= 1 && c <= SP_MAX_CHANNELS) {
+            mask |= 1 << (c - 1);
+        }
+        list = end;
+    }
+    return mask;
+}
+
+// Source channel of each lane for input with channels and the channels
+// selected by mask, returns the number of lanes. A mask that selects none
+// of the channels there are selects all of them.
+static int
+channel_map (int channels, int mask, int *map)
+{
+    int lanes = 0;
+    for (int c = 0; c < channels && lanes < SP_MAX_CHANNELS; c++) {
+        if (!mask || (mask & (1 << c))) {
+            map[lanes++] = c;
+        }
+    }
+    if (!lanes) {
+        for (int c = 0; c < channels && lanes < SP_MAX_CHANNELS; c++) {
+            map[lanes++] = c;
+        }
+    }
+    if (!lanes) {
+        // no input at all, one silent lane
+        map[lanes++] = 0;
+    }
+    return lanes;
+}
+
+// Audio thread: set up the decimator for the input rate, returns the
+// rate of the frames going into the ring
+static int
+ingest_rate (sp_core_t *s, int samplerate)
+{
+    int bandwidth = __atomic_load_n (&s->bandwidth, __ATOMIC_RELAXED);
+    if (samplerate != s->decimator_rate || bandwidth != s->decimator_bandwidth) {
+        sp_decimator_setup (&s->decimator, sp_decimator_factor (samplerate, bandwidth));
+        s->decimator_rate = samplerate;
+        s->decimator_bandwidth = bandwidth;
+    }
+    return samplerate / s->decimator.factor;
+}
+
+// Called from the audio thread: must not block, only publishes into the ring
+void
+sp_core_ingest (sp_core_t *s, const float *data, int nframes, int channels, int samplerate)
+{
+    const int timed = sp_stats_enabled (&s->stats);
+    uint64_t t0 = timed ? sp_stats_now () : 0;
+
+    int mask = __atomic_load_n (&s->channel_mask, __ATOMIC_RELAXED);
+    if (channels != s->map_channels || mask != s->map_mask || !s->map_lanes) {
+        s->map_lanes = channel_map (channels, mask, s->channel_map);
+        s->map_channels = channels;
+        s->map_mask = mask;
+    }
+    const int lanes = s->map_lanes;
+    __atomic_store_n (&s->samplerate_in, ingest_rate (s, samplerate), __ATOMIC_RELAXED);
+    __atomic_store_n (&s->lanes_in, lanes, __ATOMIC_RELAXED);
+    if (s->decimator.factor > 1) {
+        while (nframes > 0) {
+            int n = MIN (nframes, SP_DECIMATOR_CHUNK);
+            int decimated = sp_decimator_run (&s->decimator, data, n, channels, s->channel_map, lanes, s->decimated);
+            sp_ringbuf_write (&s->ring, s->decimated, decimated, lanes, NULL, lanes);
+            data += (size_t)n * channels;
+            nframes -= n;
+        }
+    }
+    else {
+        sp_ringbuf_write (&s->ring, data, nframes, channels, s->channel_map, lanes);
+    }
+
+    // wake up the worker, unless it is busy anyway
+    if (__atomic_load_n (&s->worker_running, __ATOMIC_ACQUIRE)) {
+        if (pthread_mutex_trylock (&s->worker_mutex) == 0) {
+            pthread_cond_signal (&s->worker_cond);
+            pthread_mutex_unlock (&s->worker_mutex);
+        }
+        else if (timed) {
+            sp_stats_add_count (&s->stats, SP_STAT_MISSED_WAKEUP, 1);
+        }
+    }
+    if (timed) {
+        sp_stats_add_time (&s->stats, SP_STAT_INGEST, sp_stats_now () - t0);
+    }
+}
+
+// Called from the audio thread before publishing frames at time. Playback
+// positions jitter by about a buffer, so the anchor only moves on a jump,
+// columns are placed by counting frames from there.
+static void
+anchor_update (sp_core_t *s, int64_t frame, int samplerate)
+{
+    sp_anchor_t *a = &s->anchor_w;
+    uint64_t pos = sp_ringbuf_write_pos (&s->ring);
+    int64_t drift = frame - (a->frame + (int64_t)(pos - a->pos));
+    if (a->serial && samplerate == s->anchor_rate && llabs (drift) < samplerate/4) {
+        return;
+    }
+    a->pos = pos;
+    a->frame = frame;
+    a->serial++;
+    s->anchor_rate = samplerate;
+
+    unsigned seq = s->anchor_seq;
+    __atomic_store_n (&s->anchor_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    __atomic_store_n (&s->anchor.pos, a->pos, __ATOMIC_RELAXED);
+    __atomic_store_n (&s->anchor.frame, a->frame, __ATOMIC_RELAXED);
+    __atomic_store_n (&s->anchor.serial, a->serial, __ATOMIC_RELAXED);
+    __atomic_store_n (&s->anchor_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void
+anchor_read (sp_core_t *s, sp_anchor_t *a)
+{
+    unsigned seq;
+    do {
+        seq = __atomic_load_n (&s->anchor_seq, __ATOMIC_ACQUIRE);
+        a->pos = __atomic_load_n (&s->anchor.pos, __ATOMIC_RELAXED);
+        a->frame = __atomic_load_n (&s->anchor.frame, __ATOMIC_RELAXED);
+        a->serial = __atomic_load_n (&s->anchor.serial, __ATOMIC_RELAXED);
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n (&s->anchor_seq, __ATOMIC_RELAXED));
+}
+
+void
+sp_core_ingest_at (sp_core_t *s, const float *data, int nframes, int channels, int samplerate, double time)
+{
+    if (time >= 0 && samplerate > 0) {
+        int rate = ingest_rate (s, samplerate);
+        anchor_update (s, llround (time * rate), rate);
+    }
+    sp_core_ingest (s, data, nframes, channels, samplerate);
+}
+
+void
+sp_core_set_track (sp_core_t *s, const char *key, double duration)
+{
+    if (s->source) {
+        s = s->source;
+    }
+    sp_cache_t *cache = __atomic_load_n (&s->cache, __ATOMIC_ACQUIRE);
+    char *dir = !cache && key ? cache_dir_path (&tracks_dir) : NULL;
+    if (dir) {
+        // callers may race here, one of them wins
+        sp_cache_t *expected = NULL;
+        cache = sp_cache_new (dir);
+        if (cache && !__atomic_compare_exchange_n (&s->cache, &expected, cache, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            sp_cache_free (cache);
+            cache = expected;
+        }
+        free (dir);
+    }
+    if (!cache) {
+        return;
+    }
+    sp_track_t *t = malloc (sizeof (sp_track_t));
+    if (!t) {
+        return;
+    }
+    t->key = key && duration > 0 ? sp_cache_hash (0, key, strlen (key)) : 0;
+    t->duration = duration;
+    free (__atomic_exchange_n (&s->track_next, t, __ATOMIC_ACQ_REL));
+}
+
+// Store the column analyzed from the window ending at ring position end,
+// provided it can be placed in the current track
+static void
+cache_column (sp_core_t *s, sp_cache_t *cache, uint64_t end, int hop, const sp_spectrum_t *spec)
+{
+    sp_track_t *next = __atomic_exchange_n (&s->track_next, NULL, __ATOMIC_ACQ_REL);
+    if (next) {
+        free (s->track);
+        s->track = next;
+        s->track_pos = end;
+        s->cache_serial = 0;
+    }
+
+    // one file per track and analysis setup
+    const int samplerate = (int)spec->samplerate;
+    uint64_t key = 0;
+    if (s->track && s->track->key) {
+        int setup[7] = { spec->fft_size, s->analysis->window_type, hop, samplerate, s->analysis->levels, spec->lanes,
+                         spec->mode };
+        key = sp_cache_hash (s->track->key, setup, sizeof (setup));
+    }
+    if (key != s->cache_key) {
+        sp_cache_params_t params = {
+            .key = key,
+            .fft_size = spec->fft_size,
+            .hop = hop,
+            .samplerate = samplerate,
+            .channels = spec->lanes,
+            .columns = key ? (int64_t)ceil (s->track->duration * samplerate / hop) + 1 : 0,
+        };
+        sp_cache_select (cache, key ? &params : NULL);
+        s->cache_key = key;
+    }
+    if (!key) {
+        return;
+    }
+
+    sp_anchor_t a;
+    anchor_read (s, &a);
+    uint64_t start = end - spec->fft_size;
+    if (!a.serial || start < a.pos) {
+        // window straddles a jump
+        return;
+    }
+    if (a.serial != s->cache_serial) {
+        if (!s->cache_serial) {
+            // track just changed, an older jump belongs to the previous track
+            if (a.pos + samplerate < s->track_pos) {
+                return;
+            }
+        }
+        else if (a.frame < samplerate && start < a.pos + samplerate) {
+            // A jump back to the start is usually the next track, which
+            // sp_core_set_track announces within a second or so
+            return;
+        }
+        s->cache_serial = a.serial;
+    }
+    int64_t center = a.frame + (int64_t)(start - a.pos) + spec->fft_size/2;
+    sp_cache_put (cache, center / hop, spec->data);
+}
+
+// Make sure a spectrum slot can hold the result of the current analysis
+static int
+spectrum_reserve (sp_spectrum_t *spec, int lanes, int bins)
+{
+    if (spec->capacity >= lanes * bins) {
+        return 1;
+    }
+    free (spec->data);
+    spec->data = calloc ((size_t)lanes * bins, sizeof (sp_sample_t));
+    if (!spec->data) {
+        spec->capacity = 0;
+        return 0;
+    }
+    spec->capacity = lanes * bins;
+    return 1;
+}
+
+// Room for one more column in the queue of every started follower
+static int
+followers_ready (sp_core_t *s)
+{
+    int ready = 1;
+    pthread_mutex_lock (&s->followers_mutex);
+    for (sp_core_t *f = s->followers; f && ready; f = f->next_follower) {
+        if (__atomic_load_n (&f->active, __ATOMIC_RELAXED)) {
+            ready = sp_fifo_write_slot (&f->fifo) >= 0;
+        }
+    }
+    pthread_mutex_unlock (&s->followers_mutex);
+    return ready;
+}
+
+// Queue a copy of spec for every started follower. Returns 0 if there are
+// no followers, the column then goes to the core's own queue.
+static int
+followers_queue (sp_core_t *s, const sp_spectrum_t *spec)
+{
+    pthread_mutex_lock (&s->followers_mutex);
+    const int followers = s->followers != NULL;
+    const int bins = spec->fft_size/2;
+    for (sp_core_t *f = s->followers; f; f = f->next_follower) {
+        if (!__atomic_load_n (&f->active, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        int slot = sp_fifo_write_slot (&f->fifo);
+        if (slot < 0 || !spectrum_reserve (&f->spectra[slot], spec->lanes, bins)) {
+            continue;
+        }
+        sp_spectrum_t *dst = &f->spectra[slot];
+        memcpy (dst->data, spec->data, (size_t)spec->lanes * bins * sizeof (sp_sample_t));
+        dst->lanes = spec->lanes;
+        dst->mode = spec->mode;
+        dst->fft_size = spec->fft_size;
+        dst->samplerate = spec->samplerate;
+        sp_fifo_commit (&f->fifo);
+    }
+    pthread_mutex_unlock (&s->followers_mutex);
+    return followers;
+}
+
+typedef struct {
+    sp_analysis_t *analysis;
+    int lanes;
+    int mode;
+    uint64_t center;
+    sp_sample_t *out;
+} sp_pair_job_t;
+
+static void
+pair_job (void *ctx, int pair)
+{
+    sp_pair_job_t *job = ctx;
+    if (job->analysis->levels > 1) {
+        sp_analysis_run_pyramid (job->analysis, pair, job->lanes, job->mode, job->center, job->out);
+    }
+    else {
+        sp_analysis_run (job->analysis, pair, job->lanes, job->mode, job->out);
+    }
+}
+
+// Transform the lanes in a->samples (or the pyramid, around center) into
+// out, two lanes per FFT. With a pool the pairs run side by side.
+static void
+analysis_run_lanes (sp_analysis_t *a, sp_pool_t *pool, int lanes, int mode, uint64_t center, sp_sample_t *out)
+{
+    sp_pair_job_t job = {
+        .analysis = a,
+        .lanes = lanes,
+        .mode = mode,
+        .center = center,
+        .out = out,
+    };
+    const int pairs = sp_analysis_pairs (lanes);
+    if (pool && pairs > 1 && a->size * a->levels >= SP_POOL_MIN_SIZE) {
+        sp_pool_run (pool, pairs, pair_job, &job);
+        return;
+    }
+    for (int i = 0; i < pairs; i++) {
+        pair_job (&job, i);
+    }
+}
+
+// Feed the ring up to where the pyramid can analyze the window ending at
+// end. Starts over when the window is not adjacent to what was fed before.
+static int
+pyramid_feed (sp_core_t *s, sp_analysis_t *a, uint64_t end)
+{
+    sp_pyramid_t *p = &a->pyramid;
+    const uint64_t reach = (uint64_t)a->fft_size + p->latency;
+    const uint64_t start = end > reach ? end - reach : 0;
+    const uint64_t target = end + p->latency;
+    if (!p->active || sp_pyramid_pos (p) < start || sp_pyramid_pos (p) > target) {
+        sp_pyramid_reset (p, start);
+    }
+    // samples are free until the levels are read back
+    while (sp_pyramid_pos (p) < target) {
+        int n = (int)MIN (target - sp_pyramid_pos (p), (uint64_t)a->size);
+        uint64_t chunk_end = sp_pyramid_pos (p) + n;
+        for (int i = 0; i < p->channels; i++) {
+            if (!sp_ringbuf_read (&s->ring, i, chunk_end, n, a->samples + (size_t)i * a->size)) {
+                p->active = 0;
+                return 0;
+            }
+        }
+        sp_pyramid_feed (p, a->samples, a->size, n);
+    }
+    return 1;
+}
+
+static int
+analyze_window (sp_core_t *s, uint64_t end, sp_spectrum_t *spec)
+{
+    sp_analysis_t *a = s->analysis;
+    const int lanes = __atomic_load_n (&s->lanes_in, __ATOMIC_RELAXED);
+    if (!sp_analysis_reserve (a, lanes)) {
+        return 0;
+    }
+    if (sp_analysis_pairs (lanes) > 1 && !s->pool_tried) {
+        long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+        s->pool = sp_pool_new ((int)MIN (cpus - 1, SP_POOL_THREADS));
+        s->pool_tried = 1;
+    }
+    int copied = 1;
+    if (a->levels > 1) {
+        copied = pyramid_feed (s, a, end);
+    }
+    else {
+        for (int i = 0; i < lanes && copied; i++) {
+            copied = sp_ringbuf_read (&s->ring, i, end, a->fft_size, a->samples + (size_t)i * a->size);
+        }
+    }
+    if (!copied) {
+        // the audio thread lapped us while copying
+        if (sp_stats_enabled (&s->stats)) {
+            sp_stats_add_count (&s->stats, SP_STAT_LAPPED, 1);
+        }
+        return 0;
+    }
+    const int mode = __atomic_load_n (&s->lane_mode, __ATOMIC_RELAXED);
+    if (!spectrum_reserve (spec, sp_analysis_lanes_out (lanes, mode), a->fft_size/2)) {
+        return 0;
+    }
+    spec->lanes = sp_analysis_lanes_out (lanes, mode);
+    spec->mode = mode;
+    spec->fft_size = a->fft_size;
+    spec->samplerate = (float)__atomic_load_n (&s->samplerate_in, __ATOMIC_RELAXED);
+
+    uint64_t t0 = sp_stats_enabled (&s->stats) ? sp_stats_now () : 0;
+    analysis_run_lanes (a, s->pool, lanes, mode, end - a->fft_size/2, spec->data);
+    if (t0) {
+        sp_stats_add_time (&s->stats, SP_STAT_FFT, sp_stats_now () - t0);
+    }
+    return 1;
+}
+
+int
+sp_core_planning (sp_core_t *s)
+{
+    if (s->source) {
+        s = s->source;
+    }
+    if (!s->builder_running) {
+        return 0;
+    }
+    return __atomic_load_n (&s->builder_done, __ATOMIC_ACQUIRE) != __atomic_load_n (&s->builder_request, __ATOMIC_RELAXED);
+}
+
+// Pick up a new FFT size / window built in the background. Returns 0 while
+// no setup is available at all.
+static int
+analysis_update (sp_core_t *s)
+{
+    sp_analysis_t *next = __atomic_exchange_n (&s->analysis_next, NULL, __ATOMIC_ACQ_REL);
+    if (next) {
+        sp_analysis_free (s->analysis);
+        s->analysis = next;
+    }
+    return s->analysis != NULL;
+}
+
+int
+sp_core_analyze (sp_core_t *s)
+{
+    int columns = 0;
+    int hop = __atomic_load_n (&s->hop, __ATOMIC_RELAXED);
+    sp_cache_t *cache = __atomic_load_n (&s->cache, __ATOMIC_ACQUIRE);
+
+    if (!analysis_update (s)) {
+        return 0;
+    }
+
+    // a pyramid looks a bit past the end of the window
+    const uint64_t latency = sp_analysis_latency (s->analysis);
+    for (;;) {
+        uint64_t pos = sp_ringbuf_write_pos (&s->ring);
+        if (s->next_end + latency > pos) {
+            break;
+        }
+        if (pos - s->next_end > s->ring.size - s->analysis->fft_size - 2 * latency) {
+            // fell behind by more than the ring holds, skip to the present
+            if (sp_stats_enabled (&s->stats)) {
+                sp_stats_add_count (&s->stats, SP_STAT_LAGGED, (pos - s->next_end) / hop);
+            }
+            s->next_end = pos - latency;
+        }
+
+        int slot = sp_fifo_write_slot (&s->fifo);
+        if (slot < 0 || !followers_ready (s)) {
+            // renderer is behind, the remaining hops stay buffered
+            break;
+        }
+        if (analyze_window (s, s->next_end, &s->spectra[slot])) {
+            if (cache) {
+                cache_column (s, cache, s->next_end, hop, &s->spectra[slot]);
+            }
+            if (!followers_queue (s, &s->spectra[slot])) {
+                sp_fifo_commit (&s->fifo);
+            }
+            columns++;
+        }
+        s->next_end += hop;
+    }
+    return columns;
+}
+
+static void *
+analysis_thread (void *ctx)
+{
+    sp_core_t *s = ctx;
+
+    pthread_mutex_lock (&s->worker_mutex);
+    while (!s->worker_stop) {
+        pthread_mutex_unlock (&s->worker_mutex);
+        sp_core_analyze (s);
+        if (sp_stats_enabled (&s->stats)) {
+            uint64_t t0 = sp_stats_now ();
+            pthread_mutex_lock (&s->worker_mutex);
+            sp_stats_add_time (&s->stats, SP_STAT_LOCK_WAIT, sp_stats_now () - t0);
+        }
+        else {
+            pthread_mutex_lock (&s->worker_mutex);
+        }
+        if (s->worker_stop) {
+            break;
+        }
+
+        // woken up by sp_core_ingest, the timeout only covers missed wakeups
+        // and a full queue
+        struct timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        int interval = __atomic_load_n (&s->interval, __ATOMIC_RELAXED);
+        ts.tv_nsec += (long)interval * 1000000;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait (&s->worker_cond, &s->worker_mutex, &ts);
+    }
+    pthread_mutex_unlock (&s->worker_mutex);
+    return NULL;
+}
+
+static int
+worker_start (sp_core_t *s)
+{
+    if (s->worker_running) {
+        return 0;
+    }
+    s->worker_stop = 0;
+    if (pthread_create (&s->worker, NULL, analysis_thread, s) != 0) {
+        return -1;
+    }
+    __atomic_store_n (&s->worker_running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void
+worker_stop (sp_core_t *s)
+{
+    if (!s->worker_running) {
+        return;
+    }
+    pthread_mutex_lock (&s->worker_mutex);
+    s->worker_stop = 1;
+    pthread_cond_signal (&s->worker_cond);
+    pthread_mutex_unlock (&s->worker_mutex);
+    pthread_join (s->worker, NULL);
+    __atomic_store_n (&s->worker_running, 0, __ATOMIC_RELEASE);
+}
+
+// A source analyzes while it or one of its followers is started
+static void
+source_update (sp_core_t *s)
+{
+    int active = __atomic_load_n (&s->active, __ATOMIC_RELAXED);
+    pthread_mutex_lock (&s->followers_mutex);
+    for (sp_core_t *f = s->followers; f && !active; f = f->next_follower) {
+        active = __atomic_load_n (&f->active, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock (&s->followers_mutex);
+    if (active) {
+        worker_start (s);
+    }
+    else {
+        worker_stop (s);
+    }
+}
+
+int
+sp_core_start (sp_core_t *s)
+{
+    __atomic_store_n (&s->active, 1, __ATOMIC_RELAXED);
+    return worker_start (s->source ? s->source : s);
+}
+
+void
+sp_core_stop (sp_core_t *s)
+{
+    __atomic_store_n (&s->active, 0, __ATOMIC_RELAXED);
+    if (s->source) {
+        source_update (s->source);
+    }
+    else {
+        worker_stop (s);
+    }
+}
+
+void
+sp_core_follow (sp_core_t *s, sp_core_t *source)
+{
+    if (source == s->source || source == s) {
+        return;
+    }
+    const int active = __atomic_load_n (&s->active, __ATOMIC_RELAXED);
+    if (s->source) {
+        followers_remove (s->source, s);
+        source_update (s->source);
+    }
+    else {
+        worker_stop (s);
+    }
+    s->source = source;
+    if (source) {
+        pthread_mutex_lock (&source->followers_mutex);
+        s->next_follower = source->followers;
+        source->followers = s;
+        pthread_mutex_unlock (&source->followers_mutex);
+    }
+    else {
+        // on its own again, with the setup last configured
+        sp_core_set_config (s, &s->conf);
+    }
+    if (active) {
+        worker_start (source ? source : s);
+    }
+}
+
+static inline void
+_draw_point (uint8_t *data, int stride, int x0, int y0, uint32_t color) {
+    uint32_t *ptr = (uint32_t*)&data[y0*stride+x0*4];
+    *ptr = color;
+}
+
+static inline float
+linear_interpolate (float y1, float y2, float mu)
+{
+       return (y1 * (1 - mu) + y2 * mu);
+}
+
+// Helper function to render a single channel in specified vertical range
+static void
+render_channel_spectrogram (sp_core_t *s, const sp_rowmap_t *map, const sp_sample_t *channel_data,
+                          uint8_t *data, int stride, int x, int y_end)
+{
+    float *v = s->levels;
+    int32_t *color_index = s->color_index;
+    const int db_range = MAX (s->conf.db_range, 1);
+
+    // The gradient index is an affine function of the level in dB, which
+    // in turn is one of log2 (power):
+    //   index = G - G/db_range * (10*log10 (power) + db_range - 63)
+    const float k = GRADIENT_TABLE_SIZE/(float)db_range;
+    const float a = -k * 10 * log10f (2);
+    const float b = GRADIENT_TABLE_SIZE - k * (db_range - 63);
+
+    sp_rowmap_reduce (map, channel_data, v);
+    sp_simd_log2_affine (v, v, map->rows, a, b);
+
+    // Interpolation for log scale low resolution, linear in dB and
+    // therefore in gradient space as well
+    for (int i = 0; i < map->interp_rows; i++) {
+        float v1 = b; // 0 dB
+        if (map->interp_bin[i] >= 0 && channel_data[map->interp_bin[i]] != 0) {
+            v1 = a * sp_fast_log2f (channel_data[map->interp_bin[i]]) + b;
+        }
+        v[i] = linear_interpolate (v[i], v1, map->interp_mu[i]);
+    }
+
+    sp_simd_to_index (v, color_index, map->rows, GRADIENT_TABLE_SIZE-1);
+
+    // Draw pixel at proper position (invert y for bottom-to-top frequency display)
+    for (int i = 0; i < map->rows; i++) {
+        _draw_point (data, stride, x, y_end-1-i, s->colors[color_index[i]]);
+    }
+}
+
+static int
+levels_reserve (sp_core_t *s, int rows)
+{
+    if (s->levels_capacity >= rows) {
+        return 1;
+    }
+    free (s->levels);
+    free (s->color_index);
+    s->levels = malloc (sizeof (float) * rows);
+    s->color_index = malloc (sizeof (int32_t) * rows);
+    if (!s->levels || !s->color_index) {
+        s->levels_capacity = 0;
+        return 0;
+    }
+    s->levels_capacity = rows;
+    return 1;
+}
+
+int
+sp_core_pending (sp_core_t *s)
+{
+    return (int)sp_fifo_pending (&s->fifo);
+}
+
+void
+sp_core_skip (sp_core_t *s, int n)
+{
+    int pending = sp_core_pending (s);
+    sp_fifo_release (&s->fifo, MIN (n, pending));
+    if (sp_stats_enabled (&s->stats)) {
+        sp_stats_add_count (&s->stats, SP_STAT_DROPPED, MIN (n, pending));
+    }
+}
+
+void
+sp_core_stats_enable (sp_core_t *s, int enable)
+{
+    if (enable && s->source) {
+        sp_core_stats_enable (s->source, 1);
+    }
+    if (enable && !sp_stats_enabled (&s->stats)) {
+        sp_stats_reset (&s->stats);
+    }
+    __atomic_store_n (&s->stats.enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+int
+sp_core_stats_enabled (sp_core_t *s)
+{
+    return sp_stats_enabled (&s->stats);
+}
+
+uint64_t
+sp_core_stats_clock (void)
+{
+    return sp_stats_now ();
+}
+
+void
+sp_core_stats_time (sp_core_t *s, int timer, uint64_t ns)
+{
+    if (sp_stats_enabled (&s->stats) && timer >= 0 && timer < SP_STAT_TIMER_COUNT) {
+        sp_stats_add_time (&s->stats, timer, ns);
+    }
+}
+
+void
+sp_core_stats_count (sp_core_t *s, int counter, uint64_t n)
+{
+    if (sp_stats_enabled (&s->stats) && counter >= 0 && counter < SP_STAT_COUNTER_COUNT) {
+        sp_stats_add_count (&s->stats, counter, n);
+    }
+}
+
+void
+sp_core_stats_summary (sp_core_t *s, sp_stat_summary_t *timers, uint64_t *counters)
+{
+    sp_stats_summary (&s->stats, timers, counters);
+    if (!s->source) {
+        return;
+    }
+    // a follower's analysis side is its source
+    static const int source_timers[] = { SP_STAT_INGEST, SP_STAT_FFT, SP_STAT_LOCK_WAIT };
+    static const int source_counters[] = { SP_STAT_LAGGED, SP_STAT_LAPPED, SP_STAT_MISSED_WAKEUP };
+    sp_stat_summary_t st[SP_STAT_TIMER_COUNT];
+    uint64_t sc[SP_STAT_COUNTER_COUNT];
+    sp_stats_summary (&s->source->stats, st, sc);
+    for (int i = 0; i < (int)(sizeof (source_timers)/sizeof (source_timers[0])); i++) {
+        timers[source_timers[i]] = st[source_timers[i]];
+    }
+    for (int i = 0; i < (int)(sizeof (source_counters)/sizeof (source_counters[0])); i++) {
+        counters[source_counters[i]] = sc[source_counters[i]];
+    }
+}
+
+int
+sp_core_stats_write_json (sp_core_t *s, const char *path)
+{
+    sp_stat_summary_t timers[SP_STAT_TIMER_COUNT];
+    uint64_t counters[SP_STAT_COUNTER_COUNT];
+    sp_core_stats_summary (s, timers, counters);
+
+    size_t len = strlen (path) + 5;
+    char *tmp = malloc (len);
+    if (!tmp) {
+        return -1;
+    }
+    snprintf (tmp, len, "%s.tmp", path);
+    FILE *fp = fopen (tmp, "w");
+    if (!fp) {
+        free (tmp);
+        return -1;
+    }
+    fprintf (fp, "{\n  \"timers\": {\n");
+    for (int i = 0; i < SP_STAT_TIMER_COUNT; i++) {
+        fprintf (fp, "    \"%s\": {\"count\": %llu, \"min_us\": %.2f, \"avg_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}%s\n",
+                sp_stat_timer_names[i], (unsigned long long)timers[i].count, timers[i].min_us, timers[i].avg_us,
+                timers[i].p99_us, timers[i].max_us, i < SP_STAT_TIMER_COUNT-1 ? "," : "");
+    }
+    fprintf (fp, "  },\n  \"counters\": {\n");
+    for (int i = 0; i < SP_STAT_COUNTER_COUNT; i++) {
+        fprintf (fp, "    \"%s\": %llu%s\n", sp_stat_counter_names[i], (unsigned long long)counters[i],
+                i < SP_STAT_COUNTER_COUNT-1 ? "," : "");
+    }
+    fprintf (fp, "  }\n}\n");
+
+    int res = fclose (fp) == 0 && rename (tmp, path) == 0 ? 0 : -1;
+    if (res < 0) {
+        unlink (tmp);
+    }
+    free (tmp);
+    return res;
+}
+
+// Lanes drawn for columns of lanes analyzed ones, mono goes into both
+// lanes of the stereo layout
+static inline int
+display_lanes (int lanes)
+{
+    return lanes == 1 ? 2 : lanes;
+}
+
+// Split height into n lanes. All of them are scaled from a table of
+// lane_height rows, the bottom one gets the rows left over. Returns
+// lane_height, 0 if there is no room.
+static int
+lanes_layout (sp_core_t *s, int n, int height, float samplerate, int fft_size)
+{
+    int lane_height = height / n;
+    int last = height - (n - 1) * lane_height;
+    if (lane_height < 1 || !levels_reserve (s, last)
+            || !sp_rowmap_update (&s->rowmap[0], lane_height, lane_height, samplerate, fft_size, s->conf.log_scale)
+            || !sp_rowmap_update (&s->rowmap[1], last, lane_height, samplerate, fft_size, s->conf.log_scale)) {
+        return 0;
+    }
+    return lane_height;
+}
+
+// Rasterize one spectrum into column x, one lane per channel from the top
+static void
+render_spectrum (sp_core_t *s, const sp_spectrum_t *spec, uint8_t *data, int stride, int x, int height)
+{
+    uint64_t t0 = sp_stats_enabled (&s->stats) ? sp_stats_now () : 0;
+
+    const int n = display_lanes (spec->lanes);
+    const int lane_height = lanes_layout (s, n, height, spec->samplerate, spec->fft_size);
+    if (!lane_height) {
+        return;
+    }
+    s->view_lanes = spec->lanes;
+    for (int i = 0; i < n; i++) {
+        const sp_sample_t *lane = spec->data + (size_t)MIN (i, spec->lanes - 1) * (spec->fft_size/2);
+        const int last = i == n - 1;
+        render_channel_spectrogram (s, &s->rowmap[last], lane, data, stride, x, last ? height : (i + 1) * lane_height);
+    }
+
+    if (t0) {
+        sp_stats_add_time (&s->stats, SP_STAT_RENDER, sp_stats_now () - t0);
+    }
+}
+
+int
+sp_core_render_column (sp_core_t *s, uint8_t *data, int stride, int x, int height)
+{
+    int slot = sp_fifo_read_slot (&s->fifo);
+    if (slot < 0) {
+        return 0;
+    }
+    const sp_spectrum_t *spec = &s->spectra[slot];
+    if (data) {
+        render_spectrum (s, spec, data, stride, x, height);
+    }
+    sp_history_set_budget (&s->history, __atomic_load_n (&s->history_budget, __ATOMIC_RELAXED));
+    sp_history_append (&s->history, spec->data, spec->lanes, spec->fft_size, spec->samplerate);
+    sp_fifo_release (&s->fifo, 1);
+    return 1;
+}
+
+int
+sp_core_history_length (sp_core_t *s)
+{
+    return sp_history_length (&s->history);
+}
+
+// Like render_channel_spectrogram, from quantized levels. Levels count
+// 0.5 dB steps down from full scale, which makes the gradient index a
+// plain multiple:
+//   index = G - G/db_range * (63 - level/2 + db_range - 63) = G/(2*db_range) * level
+static void
+render_channel_levels (sp_core_t *s, const sp_rowmap_t *map, const uint8_t *levels,
+                       uint8_t *data, int stride, int x, int y_end)
+{
+    float *v = s->levels;
+    int32_t *color_index = s->color_index;
+    const float k = GRADIENT_TABLE_SIZE/(float)(SP_LEVEL_STEPS_PER_DB * MAX (s->conf.db_range, 1));
+
+    sp_rowmap_reduce_levels (map, levels, k, v);
+    for (int i = 0; i < map->interp_rows; i++) {
+        float v1 = k * SP_LEVEL_FULL_SCALE * SP_LEVEL_STEPS_PER_DB; // 0 dB
+        if (map->interp_bin[i] >= 0) {
+            v1 = k * levels[map->interp_bin[i]];
+        }
+        v[i] = linear_interpolate (v[i], v1, map->interp_mu[i]);
+    }
+    sp_simd_to_index (v, color_index, map->rows, GRADIENT_TABLE_SIZE-1);
+
+    for (int i = 0; i < map->rows; i++) {
+        _draw_point (data, stride, x, y_end-1-i, s->colors[color_index[i]]);
+    }
+}
+
+// Rasterize one column of levels into column x like render_spectrum,
+// bins per lane, lane i at levels + i*lane_stride
+static int
+render_levels (sp_core_t *s, const uint8_t *levels, int lanes, int lane_stride, int bins, float samplerate,
+               uint8_t *data, int stride, int x, int height)
+{
+    const int n = display_lanes (lanes);
+    const int lane_height = lanes_layout (s, n, height, samplerate, 2 * bins);
+    if (!lane_height) {
+        return 0;
+    }
+    s->view_lanes = lanes;
+    for (int i = 0; i < n; i++) {
+        const uint8_t *lane = levels + (size_t)MIN (i, lanes - 1) * lane_stride;
+        const int last = i == n - 1;
+        render_channel_levels (s, &s->rowmap[last], lane, data, stride, x, last ? height : (i + 1) * lane_height);
+    }
+    return 1;
+}
+
+int
+sp_core_render_history (sp_core_t *s, uint8_t *data, int stride, int width, int height, int back)
+{
+    sp_history_t *h = &s->history;
+    sp_history_set_budget (h, __atomic_load_n (&s->history_budget, __ATOMIC_RELAXED));
+    for (int y = 0; y < height; y++) {
+        memset (data + y * stride, 0, width * 4);
+    }
+    if (!sp_history_length (h)) {
+        return 0;
+    }
+
+    int found = 0;
+    for (int x = 0; x < width; x++) {
+        int bins;
+        const uint8_t *column = sp_history_column (h, back + width - 1 - x, &bins);
+        if (column) {
+            // columns from the track cache may have fewer bins
+            if (!render_levels (s, column, h->lanes, h->bins, bins, h->samplerate, data, stride, x, height)) {
+                return found;
+            }
+            found++;
+        }
+    }
+    return found;
+}
+
+int
+sp_core_view_layout (sp_core_t *s, int *lanes, float *samplerate, int *fft_size)
+{
+    if (!s->view_lanes) {
+        return 0;
+    }
+    *lanes = s->view_lanes;
+    *samplerate = s->rowmap[0].samplerate;
+    *fft_size = s->rowmap[0].fft_size;
+    return display_lanes (s->view_lanes);
+}
+
+int
+sp_core_freq_row (sp_core_t *s, int lane, float hz)
+{
+    const int n = display_lanes (s->view_lanes);
+    if (!s->view_lanes || lane < 0 || lane >= n) {
+        return -1;
+    }
+    const sp_rowmap_t *m = &s->rowmap[lane == n - 1];
+    // every row is centered on the bins it stands for
+    const int row = (int)(sp_rowmap_row (m, hz) + 0.5f);
+    if (row < 0 || row >= m->rows) {
+        return -1;
+    }
+    // rows are drawn upwards from the bottom of the lane
+    return lane * s->rowmap[0].ref_rows + m->rows - 1 - row;
+}
+
+int
+sp_core_window_size (sp_core_t *s)
+{
+    return analysis_update (s) ? s->analysis->fft_size + 2 * sp_analysis_latency (s->analysis) : 0;
+}
+
+int
+sp_core_render_frames (sp_core_t *s, const float *frames, int channels, int samplerate,
+                       uint8_t *data, int stride, int x, int height)
+{
+    if (!analysis_update (s)) {
+        return 0;
+    }
+    sp_analysis_t *a = s->analysis;
+    sp_spectrum_t *spec = &s->offline;
+    int map[SP_MAX_CHANNELS];
+    const int lanes = channel_map (channels, s->conf.channel_mask, map);
+    const int mode = CLAMP (s->conf.lane_mode, 0, SP_LANES_COUNT-1);
+    if (!sp_analysis_reserve (a, lanes) || !spectrum_reserve (spec, sp_analysis_lanes_out (lanes, mode), a->fft_size/2)) {
+        return 0;
+    }
+
+    // Same channel selection as on ingest. A pyramid gets all frames, in
+    // pieces that fit the scratch buffers.
+    const int frames_in = a->fft_size + 2 * sp_analysis_latency (a);
+    const float *src = frames;
+    if (a->levels > 1) {
+        sp_pyramid_reset (&a->pyramid, 0);
+    }
+    for (int done = 0; done < frames_in; ) {
+        int n = MIN (frames_in - done, a->size);
+        for (int i = 0; i < n; i++, src += channels) {
+            for (int c = 0; c < lanes; c++) {
+                a->samples[(size_t)c * a->size + i] = map[c] < channels ? src[map[c]] : 0;
+            }
+        }
+        if (a->levels > 1) {
+            sp_pyramid_feed (&a->pyramid, a->samples, a->size, n);
+        }
+        done += n;
+    }
+    spec->lanes = sp_analysis_lanes_out (lanes, mode);
+    spec->mode = mode;
+    spec->fft_size = a->fft_size;
+    spec->samplerate = (float)samplerate;
+    // the callers run one core per thread already
+    analysis_run_lanes (a, NULL, lanes, mode, frames_in/2, spec->data);
+
+    render_spectrum (s, spec, data, stride, x, height);
+    return 1;
+}
+
+// Followers share the cache of their source
+static sp_cache_t *
+core_cache (sp_core_t *s)
+{
+    return __atomic_load_n (&(s->source ? s->source : s)->cache, __ATOMIC_ACQUIRE);
+}
+
+int
+sp_core_render_cached (sp_core_t *s, double time, int back, uint8_t *data, int stride, int x, int height)
+{
+    sp_cache_t *cache = core_cache (s);
+    if (!cache) {
+        return 0;
+    }
+    int bins, samplerate, lanes;
+    sp_cache_pin (cache);
+    const uint8_t *column = sp_cache_get (cache, time, back, &bins, &samplerate, &lanes);
+    int res = column && render_levels (s, column, lanes, bins, bins, (float)samplerate, data, stride, x, height);
+    sp_cache_unpin (cache);
+    return res;
+}
+
+int
+sp_core_history_refill (sp_core_t *s, double time, int back, int columns)
+{
+    sp_history_t *h = &s->history;
+    sp_history_set_budget (h, __atomic_load_n (&s->history_budget, __ATOMIC_RELAXED));
+    sp_history_clear (h);
+    sp_cache_t *cache = core_cache (s);
+    if (!cache) {
+        return 0;
+    }
+    int found = 0;
+    sp_cache_pin (cache);
+    for (int i = back + columns - 1; i >= back; i--) {
+        int bins, samplerate, lanes;
+        const uint8_t *column = sp_cache_get (cache, time, i, &bins, &samplerate, &lanes);
+        if (column) {
+            sp_history_append_levels (h, column, lanes, bins, (float)samplerate);
+            found++;
+        }
+        else {
+            sp_history_append_gap (h);
+        }
+    }
+    sp_cache_unpin (cache);
+    return found;
+}
@@ -0,0 +1,320 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Headless spectrogram engine: sample ingest -> FFT analysis -> column
+    rasterization into a caller provided RGB24 buffer. No GTK or DeaDBeeF
+    dependencies, so it can be driven from the plugin as well as from
+    command line tools.
+*/
+
+#ifndef __SP_CORE_H
+#define __SP_CORE_H
+
+#include <stdint.h>
+
+#define GRADIENT_TABLE_SIZE 2048
+#define SP_MAX_COLORS 7
+
+// FFT sizes selectable at runtime, powers of two
+#define SP_MIN_FFT_SIZE 1024
+#define SP_MAX_FFT_SIZE 65536
+#define SP_DEFAULT_FFT_SIZE 8192
+
+// Channels analyzed and drawn at most, one lane each (7.1)
+#define SP_MAX_CHANNELS 8
+// Lanes drawn at most, the channels and one derived from them
+#define SP_MAX_LANES (SP_MAX_CHANNELS + 1)
+
+// Frames of audio kept per channel between audio thread and analysis
+#define SP_RING_SIZE (2*SP_MAX_FFT_SIZE)
+// Analyzed columns that can be queued for the renderer
+#define SP_SPECTRUM_QUEUE 64
+
+enum {
+    SP_WINDOW_BLACKMAN_HARRIS = 0,
+    SP_WINDOW_HANN,
+    SP_WINDOW_KAISER,
+    SP_WINDOW_FLAT_TOP,
+    SP_WINDOW_COUNT
+};
+
+// Effort the background builder spends on finding a fast FFT plan. An
+// FFTW_ESTIMATE plan is used until the measured one is ready.
+enum {
+    SP_PLANNER_ESTIMATE = 0,
+    SP_PLANNER_MEASURE,
+    SP_PLANNER_PATIENT,
+    SP_PLANNER_COUNT
+};
+
+// What the lanes of the first two channels show. Derived from the same
+// FFT output, none of them costs another transform.
+enum {
+    SP_LANES_LR = 0,            // left and right as they are
+    SP_LANES_MS,                // mid (L+R)/2 and side (L-R)/2
+    SP_LANES_LR_CORRELATION,    // left, right and their phase correlation
+    SP_LANES_COUNT
+};
+
+// 16 bit per component, same range as GdkColor
+typedef struct {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+} sp_color_t;
+
+typedef struct {
+    int log_scale;
+    int db_range;
+    // upper bound of ms between analysis runs of the worker thread
+    int refresh_interval;
+    // frames between two analyzed columns, i.e. samplerate/hop_size
+    // columns per second independent of the refresh interval
+    int hop_size;
+    // Changing these rebuilds the FFT setup on a background thread, the
+    // analysis switches over once it is ready
+    int fft_size;
+    int window;
+    int planner;
+    // With log scale, analyze octave bands of the decimated signal with
+    // shorter FFTs; fft_size then sets the resolution of the lowest band
+    int multires;
+    // MB of scrollback kept for redrawing and scrolling back, 0 disables it
+    int history_size;
+    // Highest frequency in Hz to analyze, input at more than twice that
+    // rate is decimated on ingest by an integer factor; 0 keeps all of it
+    int max_bandwidth;
+    // Source channels to draw, bit i for channel i; 0 draws all of them
+    int channel_mask;
+    // SP_LANES_*, takes effect with the next column
+    int lane_mode;
+} sp_config_t;
+
+// Hot path timers. The engine records the first three, the last two are
+// for the caller's draw handler (see sp_core_stats_time).
+enum {
+    SP_STAT_INGEST = 0,     // sp_core_ingest, audio thread
+    SP_STAT_FFT,            // one analysis window incl. the power spectrum
+    SP_STAT_RENDER,         // one column rasterized
+    SP_STAT_LOCK_WAIT,      // analysis worker waiting for its mutex
+    SP_STAT_DRAW,           // columns rendered during one update of the view
+    SP_STAT_BLIT,           // compositing the image onto the widget
+    SP_STAT_TIMER_COUNT
+};
+
+enum {
+    SP_STAT_DROPPED = 0,    // analyzed columns skipped instead of drawn
+    SP_STAT_LAGGED,         // hops skipped because the analysis fell behind
+    SP_STAT_LAPPED,         // windows overwritten by the audio thread while copying
+    SP_STAT_LATE,           // redraws that came later than 1.5 refresh intervals
+    SP_STAT_MISSED_WAKEUP,  // ingest found the worker mutex busy
+    SP_STAT_COUNTER_COUNT
+};
+
+// Aggregate over the last samples of one timer
+typedef struct {
+    uint64_t count;
+    double min_us;
+    double avg_us;
+    double p99_us;
+    double max_us;
+} sp_stat_summary_t;
+
+extern const char *sp_stat_timer_names[SP_STAT_TIMER_COUNT];
+extern const char *sp_stat_counter_names[SP_STAT_COUNTER_COUNT];
+
+typedef struct sp_core_s sp_core_t;
+
+// Directory for data that can be regenerated at any time, like FFTW wisdom.
+// Process wide, set it before creating the first core; NULL disables it.
+// Cores still running when it changes pick up the new one.
+void
+sp_core_set_cache_dir (const char *dir);
+
+// Channel list like "1,2,5", counting from 1, as sp_config_t.channel_mask;
+// 0 (all channels) for an empty list
+int
+sp_core_channel_mask (const char *list);
+
+sp_core_t *
+sp_core_new (void);
+
+void
+sp_core_free (sp_core_t *core);
+
+void
+sp_core_set_config (sp_core_t *core, const sp_config_t *conf);
+
+// Nonzero if cores configured with a and b analyze alike, so one of them
+// can follow the other
+int
+sp_core_config_shares (const sp_config_t *a, const sp_config_t *b);
+
+// Shared analysis: a core following source doesn't analyze on its own,
+// the source queues every column it analyzes for each of its started
+// followers instead of for itself. Followers render them with their own
+// colors, scale and history, and share the source's track cache. The
+// analysis part of a follower's configuration is ignored, and the source
+// must outlive its followers. NULL analyzes on its own again. Call from
+// the thread that starts and stops the cores.
+void
+sp_core_follow (sp_core_t *core, sp_core_t *source);
+
+void
+sp_core_set_gradient (sp_core_t *core, const sp_color_t *colors, int num_colors);
+
+// Color of entry index of the table built from the gradient, 0 is the
+// loudest; 0xRRGGBB as written to the image
+uint32_t
+sp_core_gradient_color (sp_core_t *core, int index);
+
+// Feed interleaved float PCM. The channels in channel_mask, at most
+// SP_MAX_CHANNELS of them, are analyzed; mono is drawn into both lanes of
+// the stereo layout. Wait-free, safe to call from the audio thread
+// concurrently with analysis and rendering. Decimates according to
+// max_bandwidth first.
+void
+sp_core_ingest (sp_core_t *core, const float *data, int nframes, int channels, int samplerate);
+
+// Same, time is the position of the first frame in the current track in
+// seconds. Lets the analysis place columns in the per track cache.
+void
+sp_core_ingest_at (sp_core_t *core, const float *data, int nframes, int channels, int samplerate, double time);
+
+// Track being played, identified by key (e.g. its URI) and duration in
+// seconds; NULL if unknown. Analyzed columns are cached per track and
+// analysis setup below the cache dir. May be called from any thread, a
+// follower passes it on to its source.
+void
+sp_core_set_track (sp_core_t *core, const char *key, double duration);
+
+// Run the FFT once for every hop_size frames that arrived since the last
+// call and queue the spectra for the renderer. Returns the number of
+// columns produced, which is 0 until the first FFT plan has been built.
+// Must not be called while the analysis worker is running.
+int
+sp_core_analyze (sp_core_t *core);
+
+// Nonzero while the FFT setup for the current configuration is still being
+// built in the background
+int
+sp_core_planning (sp_core_t *core);
+
+// Start/stop the background analysis worker, which calls sp_core_analyze
+// whenever new audio is ingested. For a follower this starts its source,
+// which keeps running while any of its followers is started.
+int
+sp_core_start (sp_core_t *core);
+
+void
+sp_core_stop (sp_core_t *core);
+
+// Number of analyzed columns waiting to be rendered
+int
+sp_core_pending (sp_core_t *core);
+
+// Throw away the n oldest pending columns
+void
+sp_core_skip (sp_core_t *core, int n);
+
+// Instrumentation, off by default. Enabling also resets the statistics.
+void
+sp_core_stats_enable (sp_core_t *core, int enable);
+
+int
+sp_core_stats_enabled (sp_core_t *core);
+
+// Monotonic clock in ns for timing caller side stages
+uint64_t
+sp_core_stats_clock (void);
+
+// Record a caller side timer or counter, ignored while disabled
+void
+sp_core_stats_time (sp_core_t *core, int timer, uint64_t ns);
+
+void
+sp_core_stats_count (sp_core_t *core, int counter, uint64_t n);
+
+void
+sp_core_stats_summary (sp_core_t *core, sp_stat_summary_t *timers, uint64_t *counters);
+
+// Write the summary as JSON, replacing path atomically. Returns 0 on success.
+int
+sp_core_stats_write_json (sp_core_t *core, const char *path);
+
+// Rasterize the oldest pending spectrum into column x of an RGB24 image,
+// one lane per channel from top to bottom, and append it to the history.
+// With data NULL the column only goes to the history. Returns 0 if no
+// column was pending. Never blocks on the analysis side.
+int
+sp_core_render_column (sp_core_t *core, uint8_t *data, int stride, int x, int height);
+
+// Offline rendering, bypassing ring buffer and queue: analyze
+// sp_core_window_size () interleaved frames and rasterize the result into
+// column x exactly like sp_core_render_column would. Returns 0 while no
+// FFT setup is available. Must not be mixed with the analysis worker.
+int
+sp_core_render_frames (sp_core_t *core, const float *frames, int channels, int samplerate,
+                       uint8_t *data, int stride, int x, int height);
+
+// Rasterize the cached column back hops before the one playing at time
+// (seconds into the current track) into column x. Returns 0 if that part
+// of the track has not been analyzed yet.
+int
+sp_core_render_cached (sp_core_t *core, double time, int back, uint8_t *data, int stride, int x, int height);
+
+// Start the history over with the cached columns back + columns - 1 down
+// to back hops before the one playing at time, as sp_core_render_cached
+// finds them, so it continues the view repainted from the cache. Parts
+// of the track not analyzed yet stay black. Returns the number of
+// columns found.
+int
+sp_core_history_refill (sp_core_t *core, double time, int back, int columns);
+
+// Columns in the history
+int
+sp_core_history_length (sp_core_t *core);
+
+// Rasterize width columns of the history into x = 0 .. width-1 of an RGB24
+// image with the current colors, dB range and scale, the column back
+// columns before the newest one at the right edge. Columns that are not
+// kept are black. Returns the number of columns found in the history.
+int
+sp_core_render_history (sp_core_t *core, uint8_t *data, int stride, int width, int height, int back);
+
+// Layout of the view as rasterized last by the calls above, for drawing
+// axes over it: lanes as analyzed (the last one derived with
+// SP_LANES_LR_CORRELATION), samplerate and FFT size. Returns the number
+// of lanes drawn, 0 before the first column. Same thread as rendering.
+int
+sp_core_view_layout (sp_core_t *core, int *lanes, float *samplerate, int *fft_size);
+
+// Image row that shows frequency hz in lane (from the top) of that
+// layout, -1 if it isn't shown
+int
+sp_core_freq_row (sp_core_t *core, int lane, float hz);
+
+// Frames analyzed per column, 0 while no FFT setup is available. More than
+// the FFT size with multires, the column is centered on these frames.
+int
+sp_core_window_size (sp_core_t *core);
+
+#endif // __SP_CORE_H
@@ -0,0 +1,115 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "sp_decimator.h"
+#include "sp_analysis.h"
+
+int
+sp_decimator_factor (int samplerate, int bandwidth)
+{
+    if (bandwidth <= 0) {
+        return 1;
+    }
+    // the output's Nyquist frequency must not end below bandwidth
+    int factor = samplerate / (2 * bandwidth);
+    if (factor < 2) {
+        return 1;
+    }
+    return factor < SP_DECIMATOR_MAX_FACTOR ? factor : SP_DECIMATOR_MAX_FACTOR;
+}
+
+// Kaiser (beta 8) windowed sinc with the cutoff below the output's Nyquist
+// frequency: passes 0 .. 0.375 of the output rate within 0.1 dB and
+// attenuates from 0.5 on by 80 dB, so nothing above the output's Nyquist
+// frequency folds back into the band, the top quarter only rolls off
+void
+sp_decimator_setup (sp_decimator_t *d, int factor)
+{
+    memset (d, 0, sizeof (sp_decimator_t));
+    d->factor = factor < 1 ? 1 : (factor > SP_DECIMATOR_MAX_FACTOR ? SP_DECIMATOR_MAX_FACTOR : factor);
+    if (d->factor == 1) {
+        return;
+    }
+    const int n = d->factor * SP_DECIMATOR_PHASE_TAPS;
+    const double center = (n - 1) / 2.0;
+    double h[SP_DECIMATOR_MAX_TAPS];
+    double sum = 0;
+    for (int k = 0; k < n; k++) {
+        double t = (k - center) / d->factor;
+        double x = SP_DECIMATOR_CUTOFF * t;
+        double sinc = x == 0 ? 1.0 : sin (M_PI * x) / (M_PI * x);
+        h[k] = sinc * sp_analysis_kaiser (2.0 * k / (n - 1) - 1.0, 8.0);
+        sum += h[k];
+    }
+    for (int k = 0; k < n; k++) {
+        d->coef[n - 1 - k] = (float)(h[k] / sum);
+    }
+    d->taps = n;
+}
+
+static inline float
+dot (const float *a, const float *b, int n)
+{
+    // taps are a multiple of 4, independent sums keep the FPU busy
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i < n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i+1] * b[i+1];
+        s2 += a[i+2] * b[i+2];
+        s3 += a[i+3] * b[i+3];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+// Polyphase decimation: the filter only runs for every factor-th frame,
+// the other frames just enter the delay line
+int
+sp_decimator_run (sp_decimator_t *d, const float *in, int nframes, int channels, const int *map, int lanes,
+                  float *out)
+{
+    const int taps = d->taps;
+    int written = 0;
+    for (int i = 0; i < nframes; i++, in += channels) {
+        if (d->factor == 1) {
+            for (int c = 0; c < lanes; c++) {
+                out[lanes*written+c] = map[c] < channels ? in[map[c]] : 0;
+            }
+            written++;
+            continue;
+        }
+        for (int c = 0; c < lanes; c++) {
+            d->line[c][d->pos] = d->line[c][d->pos + taps] = map[c] < channels ? in[map[c]] : 0;
+        }
+        if (++d->pos == taps) {
+            d->pos = 0;
+        }
+        if (++d->phase == d->factor) {
+            d->phase = 0;
+            for (int c = 0; c < lanes; c++) {
+                out[lanes*written+c] = dot (d->line[c] + d->pos, d->coef, taps);
+            }
+            written++;
+        }
+    }
+    return written;
+}
@@ -0,0 +1,75 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Integer factor low-pass decimator for up to SP_MAX_CHANNELS channels of
+    interleaved input, run on the audio thread before frames go into the
+    ring buffer. Works in place on fixed size state: no allocation and no
+    locking, only setting up a new factor computes the filter.
+*/
+
+#ifndef __SP_DECIMATOR_H
+#define __SP_DECIMATOR_H
+
+#include "sp_core.h"
+
+#define SP_DECIMATOR_MAX_FACTOR 8
+// Filter taps per unit of factor, sets the transition band to about an
+// eighth of the output rate
+#define SP_DECIMATOR_PHASE_TAPS 48
+// Cutoff relative to the output's Nyquist frequency, low enough that the
+// transition band ends right at it
+#define SP_DECIMATOR_CUTOFF 0.87
+#define SP_DECIMATOR_MAX_TAPS (SP_DECIMATOR_MAX_FACTOR * SP_DECIMATOR_PHASE_TAPS)
+// Input frames callers should pass at most per call, the output of that
+// many fits into lanes * SP_DECIMATOR_CHUNK floats for every factor
+#define SP_DECIMATOR_CHUNK 1024
+
+typedef struct {
+    int factor;
+    int taps;
+    // time reversed impulse response, so each output is a plain dot
+    // product with the delay line
+    float coef[SP_DECIMATOR_MAX_TAPS];
+    // last taps input frames per channel, stored twice so that they are
+    // contiguous from pos on
+    float line[SP_MAX_CHANNELS][2 * SP_DECIMATOR_MAX_TAPS];
+    int pos;
+    int phase;      // input frames since the last output
+} sp_decimator_t;
+
+// Largest factor that keeps the output's Nyquist frequency at or above
+// bandwidth, 1 if bandwidth is 0 or that factor would be below 2
+int
+sp_decimator_factor (int samplerate, int bandwidth);
+
+// Start over with a new factor, 1 passes frames through
+void
+sp_decimator_setup (sp_decimator_t *d, int factor);
+
+// Consume nframes of interleaved input and write at most
+// nframes / factor + 1 frames of lanes interleaved channels to out, lane i
+// taken from input channel map[i] (silence if the input does not have it).
+// Returns the frames written.
+int
+sp_decimator_run (sp_decimator_t *d, const float *in, int nframes, int channels, const int *map, int lanes,
+                  float *out);
+
+#endif // __SP_DECIMATOR_H
@@ -0,0 +1,65 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    FFT precision selection. The engine works in single precision by default
+    (fftwf, float buffers end to end); building with -DSP_FFT_DOUBLE switches
+    every sample, window and spectrum buffer as well as the plans back to
+    double precision fftw.
+*/
+
+#ifndef __SP_FFT_H
+#define __SP_FFT_H
+
+#include <fftw3.h>
+
+#ifdef SP_FFT_DOUBLE
+typedef double sp_sample_t;
+typedef fftw_complex sp_fft_complex;
+typedef fftw_plan sp_fft_plan;
+#define sp_fft_malloc fftw_malloc
+#define sp_fft_free fftw_free
+#define sp_fft_plan_dft_r2c_1d fftw_plan_dft_r2c_1d
+#define sp_fft_plan_dft_1d fftw_plan_dft_1d
+#define sp_fft_execute fftw_execute
+#define sp_fft_execute_dft fftw_execute_dft
+#define sp_fft_destroy_plan fftw_destroy_plan
+#define sp_fft_set_timelimit fftw_set_timelimit
+#define sp_fft_import_wisdom_from_filename fftw_import_wisdom_from_filename
+#define sp_fft_export_wisdom_to_filename fftw_export_wisdom_to_filename
+#define SP_FFT_WISDOM_FILE "fftw3.wisdom"
+#else
+typedef float sp_sample_t;
+typedef fftwf_complex sp_fft_complex;
+typedef fftwf_plan sp_fft_plan;
+#define sp_fft_malloc fftwf_malloc
+#define sp_fft_free fftwf_free
+#define sp_fft_plan_dft_r2c_1d fftwf_plan_dft_r2c_1d
+#define sp_fft_plan_dft_1d fftwf_plan_dft_1d
+#define sp_fft_execute fftwf_execute
+#define sp_fft_execute_dft fftwf_execute_dft
+#define sp_fft_destroy_plan fftwf_destroy_plan
+#define sp_fft_set_timelimit fftwf_set_timelimit
+#define sp_fft_import_wisdom_from_filename fftwf_import_wisdom_from_filename
+#define sp_fft_export_wisdom_to_filename fftwf_export_wisdom_to_filename
+#define SP_FFT_WISDOM_FILE "fftw3f.wisdom"
+#endif
+
+#endif // __SP_FFT_H
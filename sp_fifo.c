@@ -0,0 +1,72 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "sp_fifo.h"
+
+void
+sp_fifo_init (sp_fifo_t *f, uint32_t size)
+{
+    f->size = size;
+    f->mask = size - 1;
+    f->head = 0;
+    f->tail = 0;
+}
+
+int
+sp_fifo_write_slot (sp_fifo_t *f)
+{
+    uint32_t head = __atomic_load_n (&f->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n (&f->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= f->size) {
+        return -1;
+    }
+    return head & f->mask;
+}
+
+void
+sp_fifo_commit (sp_fifo_t *f)
+{
+    uint32_t head = __atomic_load_n (&f->head, __ATOMIC_RELAXED);
+    __atomic_store_n (&f->head, head + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t
+sp_fifo_pending (sp_fifo_t *f)
+{
+    uint32_t head = __atomic_load_n (&f->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n (&f->tail, __ATOMIC_RELAXED);
+    return head - tail;
+}
+
+int
+sp_fifo_read_slot (sp_fifo_t *f)
+{
+    if (sp_fifo_pending (f) == 0) {
+        return -1;
+    }
+    return __atomic_load_n (&f->tail, __ATOMIC_RELAXED) & f->mask;
+}
+
+void
+sp_fifo_release (sp_fifo_t *f, uint32_t n)
+{
+    uint32_t tail = __atomic_load_n (&f->tail, __ATOMIC_RELAXED);
+    __atomic_store_n (&f->tail, tail + n, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,65 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Lock-free single producer / single consumer FIFO index management.
+
+    The payload slots are owned by the user of this module, the FIFO only
+    hands out slot indices: the writer fills sp_fifo_write_slot () and then
+    commits it, the reader processes sp_fifo_read_slot () and then releases
+    it. Neither side ever waits; a full FIFO is reported to the writer.
+*/
+
+#ifndef __SP_FIFO_H
+#define __SP_FIFO_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t size;  // power of two
+    uint32_t mask;
+    uint32_t head;  // next slot to write, accessed atomically
+    uint32_t tail;  // next slot to read, accessed atomically
+} sp_fifo_t;
+
+// size must be a power of two
+void
+sp_fifo_init (sp_fifo_t *f, uint32_t size);
+
+// Writer: index of a free slot, or -1 if the FIFO is full
+int
+sp_fifo_write_slot (sp_fifo_t *f);
+
+void
+sp_fifo_commit (sp_fifo_t *f);
+
+// Reader: number of committed slots not yet released
+uint32_t
+sp_fifo_pending (sp_fifo_t *f);
+
+// Reader: index of the oldest committed slot, or -1 if the FIFO is empty
+int
+sp_fifo_read_slot (sp_fifo_t *f);
+
+// Reader: release the n oldest slots
+void
+sp_fifo_release (sp_fifo_t *f, uint32_t n);
+
+#endif // __SP_FIFO_H
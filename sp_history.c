@@ -0,0 +1,178 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sp_history.h"
+#include "sp_level.h"
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+void
+sp_history_init (sp_history_t *h)
+{
+    memset (h, 0, sizeof (sp_history_t));
+}
+
+void
+sp_history_free (sp_history_t *h)
+{
+    free (h->data);
+    free (h->column_bins);
+    sp_history_init (h);
+}
+
+void
+sp_history_set_budget (sp_history_t *h, size_t bytes)
+{
+    if (bytes != h->budget) {
+        sp_history_free (h);
+        h->budget = bytes;
+    }
+}
+
+void
+sp_history_clear (sp_history_t *h)
+{
+    h->count = 0;
+}
+
+// Bins kept per lane for columns of fft_size, and FFT bins per kept bin
+static int
+history_bins (int fft_size, int *group)
+{
+    int bins = fft_size / 2;
+    *group = 1;
+    while (bins > SP_HISTORY_MAX_BINS) {
+        bins /= 2;
+        *group *= 2;
+    }
+    return bins;
+}
+
+// Size the ring for columns of up to bins per lane, the memory is
+// allocated up front. Columns kept in a layout of the same lanes and
+// samplerate are carried over, as many as fit.
+static int
+history_layout (sp_history_t *h, int lanes, int bins, float samplerate)
+{
+    const int capacity = (int)(h->budget / (lanes * (size_t)bins));
+    if (capacity < 1) {
+        return 0;
+    }
+    uint8_t *data = malloc ((size_t)capacity * lanes * bins);
+    uint16_t *column_bins = malloc (capacity * sizeof (uint16_t));
+    if (!data || !column_bins) {
+        const size_t budget = h->budget;
+        free (data);
+        free (column_bins);
+        sp_history_free (h);
+        h->budget = budget;
+        return 0;
+    }
+    int count = 0;
+    if (h->data && lanes == h->lanes && samplerate == h->samplerate && bins >= h->bins) {
+        count = MIN (sp_history_length (h), capacity);
+        for (int i = 0; i < count; i++) {
+            const uint64_t src = (h->count - count + i) % h->capacity;
+            for (int j = 0; j < lanes; j++) {
+                memcpy (data + ((size_t)i * lanes + j) * bins, h->data + (src * lanes + j) * h->bins, h->bins);
+            }
+            column_bins[i] = h->column_bins[src];
+        }
+    }
+    free (h->data);
+    free (h->column_bins);
+    h->data = data;
+    h->column_bins = column_bins;
+    h->lanes = lanes;
+    h->bins = bins;
+    h->samplerate = samplerate;
+    h->capacity = capacity;
+    h->count = count;
+    return 1;
+}
+
+// Slot for the next column of bins per lane, NULL if there is none
+static uint8_t *
+history_next (sp_history_t *h, int lanes, int bins, float samplerate)
+{
+    if (!h->budget) {
+        return NULL;
+    }
+    if ((!h->data || lanes != h->lanes || samplerate != h->samplerate || bins > h->bins)
+        && !history_layout (h, lanes, bins, samplerate)) {
+        return NULL;
+    }
+    const uint64_t i = h->count % h->capacity;
+    h->column_bins[i] = bins;
+    h->count++;
+    return h->data + i * h->lanes * h->bins;
+}
+
+void
+sp_history_append (sp_history_t *h, const sp_sample_t *data, int lanes, int fft_size, float samplerate)
+{
+    int group;
+    const int bins = history_bins (fft_size, &group);
+    uint8_t *column = history_next (h, lanes, bins, samplerate);
+    for (int j = 0; column && j < lanes; j++) {
+        sp_level_quantize (data + (size_t)j * (fft_size/2), column + j * h->bins, bins, group);
+    }
+}
+
+void
+sp_history_append_levels (sp_history_t *h, const uint8_t *levels, int lanes, int bins, float samplerate)
+{
+    uint8_t *column = history_next (h, lanes, bins, samplerate);
+    for (int j = 0; column && j < lanes; j++) {
+        memcpy (column + j * h->bins, levels + (size_t)j * bins, bins);
+    }
+}
+
+void
+sp_history_append_gap (sp_history_t *h)
+{
+    if (!h->data || !h->count) {
+        return;
+    }
+    h->column_bins[h->count % h->capacity] = 0;
+    h->count++;
+}
+
+int
+sp_history_length (const sp_history_t *h)
+{
+    return h->count < (uint64_t)h->capacity ? (int)h->count : h->capacity;
+}
+
+const uint8_t *
+sp_history_column (const sp_history_t *h, int back, int *bins)
+{
+    if (back < 0 || back >= sp_history_length (h)) {
+        return NULL;
+    }
+    const uint64_t i = (h->count - 1 - back) % h->capacity;
+    *bins = h->column_bins[i];
+    return *bins ? h->data + i * h->lanes * h->bins : NULL;
+}
@@ -0,0 +1,92 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Scrollback of rendered columns as quantized levels (sp_level.h), so the
+    visible area can be rasterized again after the palette, dB range, scale
+    or size changed, and the user can look back in time. A ring of fixed
+    size, the oldest columns are dropped once the budget is used up.
+*/
+
+#ifndef __SP_HISTORY_H
+#define __SP_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sp_fft.h"
+
+// Higher resolutions are max-reduced to this many bins per channel
+#define SP_HISTORY_MAX_BINS 4096
+
+typedef struct {
+    uint8_t *data;
+    // bins per lane of each column, 0 for gaps
+    uint16_t *column_bins;
+    size_t budget;
+    // layout of the columns kept, taken from the first one appended
+    int lanes;
+    int bins;       // per lane, the most any column has
+    float samplerate;
+    int capacity;   // columns
+    uint64_t count; // columns appended since the last reset
+} sp_history_t;
+
+void
+sp_history_init (sp_history_t *h);
+
+void
+sp_history_free (sp_history_t *h);
+
+// Bytes to spend, 0 disables the history. Changing it drops the columns.
+void
+sp_history_set_budget (sp_history_t *h, size_t bytes);
+
+// Drop the columns, keeping the layout
+void
+sp_history_clear (sp_history_t *h);
+
+// Append a column of fft_size/2 power values per lane, lane i at
+// data + i*fft_size/2. The history starts over if the number of lanes or
+// the samplerate differ from the columns kept. Columns of different
+// resolution are kept as they are.
+void
+sp_history_append (sp_history_t *h, const sp_sample_t *data, int lanes, int fft_size, float samplerate);
+
+// Append a column that is quantized already, bins (at most
+// SP_HISTORY_MAX_BINS) levels per lane, lane i at levels + i*bins;
+// otherwise like sp_history_append
+void
+sp_history_append_levels (sp_history_t *h, const uint8_t *levels, int lanes, int bins, float samplerate);
+
+// Append a column that is not known, it reads as NULL. Ignored while the
+// history is empty, where there is nothing to keep apart.
+void
+sp_history_append_gap (sp_history_t *h);
+
+int
+sp_history_length (const sp_history_t *h);
+
+// Levels of the column back columns before the newest one, lane i at
+// i*h->bins, the first *bins of them used. NULL if it is not kept or a gap.
+const uint8_t *
+sp_history_column (const sp_history_t *h, int back, int *bins);
+
+#endif // __SP_HISTORY_H
@@ -0,0 +1,38 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <math.h>
+
+#include "sp_level.h"
+#include "sp_simd.h"
+
+void
+sp_level_quantize (const sp_sample_t *power, uint8_t *out, int bins, int group)
+{
+    const float scale = -10 * log10f (2) * SP_LEVEL_STEPS_PER_DB;
+    for (int i = 0; i < bins; i++) {
+        sp_sample_t p = power[i*group];
+        for (int j = 1; j < group; j++) {
+            p = power[i*group+j] > p ? power[i*group+j] : p;
+        }
+        float q = SP_LEVEL_FULL_SCALE * SP_LEVEL_STEPS_PER_DB + scale * sp_fast_log2f ((float)p);
+        out[i] = q <= 0 ? 0 : q >= 255 ? 255 : (uint8_t)(q + 0.5f);
+    }
+}
@@ -0,0 +1,43 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Compact representation of power values: one byte per bin in 0.5 dB
+    steps below full scale, which is 63 dB (the top of the gradient), so a
+    byte covers 127.5 dB. Used wherever columns are kept around, in memory
+    or on disk.
+*/
+
+#ifndef __SP_LEVEL_H
+#define __SP_LEVEL_H
+
+#include <stdint.h>
+
+#include "sp_fft.h"
+
+#define SP_LEVEL_STEPS_PER_DB 2
+#define SP_LEVEL_FULL_SCALE 63
+
+// Max over each group of consecutive bins, bins*group power values in,
+// bins levels out
+void
+sp_level_quantize (const sp_sample_t *power, uint8_t *out, int bins, int group);
+
+#endif // __SP_LEVEL_H
@@ -0,0 +1,165 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sp_pool.h"
+
+#define SP_POOL_MAX_THREADS 16
+
+struct sp_pool_s {
+    pthread_t threads[SP_POOL_MAX_THREADS];
+    int num_threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    // Current batch: bumping generation hands it to the helpers, next is
+    // the first job nobody has taken yet (accessed atomically) and active
+    // counts the helpers still working on it
+    unsigned generation;
+    sp_pool_job_t job;
+    void *ctx;
+    int n;
+    int next;
+    int active;
+    int stop;
+};
+
+// Take jobs of the current batch until none are left
+static void
+pool_work (sp_pool_t *p, sp_pool_job_t job, void *ctx, int n)
+{
+    int i;
+    while ((i = __atomic_fetch_add (&p->next, 1, __ATOMIC_ACQ_REL)) < n) {
+        job (ctx, i);
+    }
+}
+
+static void *
+pool_thread (void *ctx)
+{
+    sp_pool_t *p = ctx;
+    unsigned seen = 0;
+
+    pthread_mutex_lock (&p->mutex);
+    for (;;) {
+        while (!p->stop && p->generation == seen) {
+            pthread_cond_wait (&p->start, &p->mutex);
+        }
+        if (p->stop) {
+            break;
+        }
+        seen = p->generation;
+        sp_pool_job_t job = p->job;
+        void *job_ctx = p->ctx;
+        int n = p->n;
+        pthread_mutex_unlock (&p->mutex);
+
+        pool_work (p, job, job_ctx, n);
+
+        pthread_mutex_lock (&p->mutex);
+        if (--p->active == 0) {
+            pthread_cond_signal (&p->done);
+        }
+    }
+    pthread_mutex_unlock (&p->mutex);
+    return NULL;
+}
+
+sp_pool_t *
+sp_pool_new (int threads)
+{
+    if (threads < 1) {
+        return NULL;
+    }
+    if (threads > SP_POOL_MAX_THREADS) {
+        threads = SP_POOL_MAX_THREADS;
+    }
+    sp_pool_t *p = malloc (sizeof (sp_pool_t));
+    if (!p) {
+        return NULL;
+    }
+    memset (p, 0, sizeof (sp_pool_t));
+    pthread_mutex_init (&p->mutex, NULL);
+    pthread_cond_init (&p->start, NULL);
+    pthread_cond_init (&p->done, NULL);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create (&p->threads[i], NULL, pool_thread, p) != 0) {
+            break;
+        }
+        p->num_threads++;
+    }
+    if (!p->num_threads) {
+        sp_pool_free (p);
+        return NULL;
+    }
+    return p;
+}
+
+void
+sp_pool_free (sp_pool_t *p)
+{
+    if (!p) {
+        return;
+    }
+    pthread_mutex_lock (&p->mutex);
+    p->stop = 1;
+    pthread_cond_broadcast (&p->start);
+    pthread_mutex_unlock (&p->mutex);
+    for (int i = 0; i < p->num_threads; i++) {
+        pthread_join (p->threads[i], NULL);
+    }
+    pthread_cond_destroy (&p->done);
+    pthread_cond_destroy (&p->start);
+    pthread_mutex_destroy (&p->mutex);
+    free (p);
+}
+
+void
+sp_pool_run (sp_pool_t *p, int n, sp_pool_job_t job, void *ctx)
+{
+    if (n <= 1) {
+        if (n == 1) {
+            job (ctx, 0);
+        }
+        return;
+    }
+    pthread_mutex_lock (&p->mutex);
+    p->job = job;
+    p->ctx = ctx;
+    p->n = n;
+    p->next = 0;
+    p->active = p->num_threads;
+    p->generation++;
+    pthread_cond_broadcast (&p->start);
+    pthread_mutex_unlock (&p->mutex);
+
+    pool_work (p, job, ctx, n);
+
+    // helpers that found no job left still have to check in, so none of
+    // them reads the batch after it has been replaced
+    pthread_mutex_lock (&p->mutex);
+    while (p->active > 0) {
+        pthread_cond_wait (&p->done, &p->mutex);
+    }
+    pthread_mutex_unlock (&p->mutex);
+}
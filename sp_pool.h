@@ -0,0 +1,46 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Small fork-join pool for splitting one analysis window into independent
+    jobs, e.g. the FFTs of the channel pairs. The calling thread takes part
+    in the work, so a pool of n threads runs up to n+1 jobs at once.
+*/
+
+#ifndef __SP_POOL_H
+#define __SP_POOL_H
+
+typedef struct sp_pool_s sp_pool_t;
+
+typedef void (*sp_pool_job_t) (void *ctx, int index);
+
+// threads helpers besides the caller; NULL if none could be started
+sp_pool_t *
+sp_pool_new (int threads);
+
+void
+sp_pool_free (sp_pool_t *p);
+
+// Call job (ctx, i) for i = 0 .. n-1 and return once all of them are done.
+// Only one thread may run jobs on a pool at a time.
+void
+sp_pool_run (sp_pool_t *p, int n, sp_pool_job_t job, void *ctx);
+
+#endif // __SP_POOL_H
@@ -0,0 +1,165 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sp_pyramid.h"
+
+// Half-band low-pass, Kaiser (beta 8) windowed sinc with 43 taps. Every
+// other tap is zero, these are the ones at odd distances 1, 3, .. 21 from
+// the center tap of 0.5. Passes 0 .. 0.1875 of the input rate within 1e-4
+// and attenuates 0.3125 .. 0.5 by 80 dB, so after decimation everything
+// below 0.375 of the new rate is free of aliases.
+#define HB_TAPS 11
+#define HB_REACH (2*HB_TAPS - 1)
+
+static const sp_sample_t halfband[HB_TAPS] = {
+    3.158579117e-01f,
+    -9.894334404e-02f,
+    5.235164521e-02f,
+    -3.084688506e-02f,
+    1.841728820e-02f,
+    -1.067706049e-02f,
+    5.834568115e-03f,
+    -2.916423392e-03f,
+    1.278974483e-03f,
+    -4.556204639e-04f,
+    1.068473928e-04f,
+};
+
+int
+sp_pyramid_levels (int span)
+{
+    int levels = 1;
+    while (levels < SP_PYRAMID_MAX_LEVELS && (span >> levels) >= SP_PYRAMID_MIN_SIZE) {
+        levels++;
+    }
+    return levels;
+}
+
+int
+sp_pyramid_init (sp_pyramid_t *p, int levels, int size, int span, int channels)
+{
+    memset (p, 0, sizeof (sp_pyramid_t));
+    if (levels < 1 || levels > SP_PYRAMID_MAX_LEVELS || channels < 1) {
+        return -1;
+    }
+    p->levels = levels;
+    p->size = size;
+    p->channels = channels;
+    p->latency = HB_REACH * ((1 << (levels - 1)) - 1);
+
+    for (int l = 0; l < levels; l++) {
+        // the oldest window still being read lies about span/2 + latency
+        // behind the newest sample
+        uint32_t need = (uint32_t)(((span + 2 * p->latency) >> l) + size + 2 * HB_REACH + 2);
+        uint32_t cap = 1;
+        while (cap < need) {
+            cap <<= 1;
+        }
+        p->mask[l] = cap - 1;
+        p->ring[l] = calloc ((size_t)cap * channels, sizeof (sp_sample_t));
+        if (!p->ring[l]) {
+            sp_pyramid_free (p);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+sp_pyramid_free (sp_pyramid_t *p)
+{
+    for (int l = 0; l < SP_PYRAMID_MAX_LEVELS; l++) {
+        free (p->ring[l]);
+    }
+    memset (p, 0, sizeof (sp_pyramid_t));
+}
+
+void
+sp_pyramid_reset (sp_pyramid_t *p, uint64_t origin)
+{
+    memset (p->count, 0, sizeof (p->count));
+    p->origin = origin;
+    p->active = 1;
+}
+
+uint64_t
+sp_pyramid_pos (const sp_pyramid_t *p)
+{
+    return p->origin + p->count[0];
+}
+
+// Sample i of a level, silence before the first one
+static inline sp_sample_t
+tap (const sp_sample_t *ring, uint32_t mask, int64_t i)
+{
+    return i < 0 ? 0 : ring[i & mask];
+}
+
+void
+sp_pyramid_feed (sp_pyramid_t *p, const sp_sample_t *in, int stride, int n)
+{
+    const uint32_t mask0 = p->mask[0];
+    for (int ch = 0; ch < p->channels; ch++) {
+        sp_sample_t *ring = p->ring[0] + (size_t)ch * (mask0 + 1);
+        const sp_sample_t *src = in + (size_t)ch * stride;
+        for (int i = 0; i < n; i++) {
+            ring[(uint32_t)(p->count[0] + i) & mask0] = src[i];
+        }
+    }
+    p->count[0] += n;
+
+    // Sample j of level l is the filtered level l-1 around sample 2j and
+    // can be produced once 2j + HB_REACH arrived there
+    for (int l = 1; l < p->levels; l++) {
+        const uint32_t mask_in = p->mask[l-1];
+        const uint32_t mask_out = p->mask[l];
+        while ((int64_t)(2 * p->count[l]) + HB_REACH < (int64_t)p->count[l-1]) {
+            const int64_t m = 2 * p->count[l];
+            for (int ch = 0; ch < p->channels; ch++) {
+                const sp_sample_t *src = p->ring[l-1] + (size_t)ch * (mask_in + 1);
+                sp_sample_t acc = 0.5f * tap (src, mask_in, m);
+                for (int t = 0; t < HB_TAPS; t++) {
+                    const int d = 2 * t + 1;
+                    acc += halfband[t] * (tap (src, mask_in, m - d) + tap (src, mask_in, m + d));
+                }
+                p->ring[l][(size_t)ch * (mask_out + 1) + (p->count[l] & mask_out)] = acc;
+            }
+            p->count[l]++;
+        }
+    }
+}
+
+void
+sp_pyramid_read (const sp_pyramid_t *p, int level, int channel, uint64_t center, sp_sample_t *out)
+{
+    const int64_t half = level > 0 ? (int64_t)1 << (level - 1) : 0;
+    const int64_t c = ((int64_t)(center - p->origin) + half) >> level;
+    const int64_t start = c - p->size/2;
+    const int64_t count = (int64_t)p->count[level];
+    const uint32_t mask = p->mask[level];
+    const sp_sample_t *ring = p->ring[level] + (size_t)channel * (mask + 1);
+    for (int i = 0; i < p->size; i++) {
+        int64_t j = start + i;
+        out[i] = j < 0 || j >= count ? 0 : ring[j & mask];
+    }
+}
@@ -0,0 +1,83 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Octave band decimation for the multi-resolution analysis. The input is
+    halved in rate once per level by a half-band low-pass, so a short FFT on
+    level l sees 2^l times the time span at 2^l times the frequency
+    resolution of level 0. Each level keeps the recent samples of every
+    channel in a ring, one plane per channel; sample j of level l lies at
+    frame origin + j*2^l of the input.
+*/
+
+#ifndef __SP_PYRAMID_H
+#define __SP_PYRAMID_H
+
+#include <stdint.h>
+
+#include "sp_fft.h"
+
+#define SP_PYRAMID_MAX_LEVELS 5
+// Shortest FFT run per level
+#define SP_PYRAMID_MIN_SIZE 1024
+
+typedef struct {
+    int levels;
+    int size;       // window length on every level
+    int channels;
+    int latency;    // input frames past a window's end the last level needs
+    sp_sample_t *ring[SP_PYRAMID_MAX_LEVELS];
+    uint32_t mask[SP_PYRAMID_MAX_LEVELS];
+    uint64_t count[SP_PYRAMID_MAX_LEVELS];  // samples produced per level
+    uint64_t origin;
+    int active;     // fed since the last reset
+} sp_pyramid_t;
+
+// Number of levels for windows spanning span input frames, 1 if span is
+// too short to be split
+int
+sp_pyramid_levels (int span);
+
+// Levels with size samples each, enough history for windows spanning span
+// input frames
+int
+sp_pyramid_init (sp_pyramid_t *p, int levels, int size, int span, int channels);
+
+void
+sp_pyramid_free (sp_pyramid_t *p);
+
+// Drop everything, the next frame fed is input frame origin
+void
+sp_pyramid_reset (sp_pyramid_t *p, uint64_t origin);
+
+// Input frame the next call to sp_pyramid_feed starts at
+uint64_t
+sp_pyramid_pos (const sp_pyramid_t *p);
+
+// n frames, channel c at in + c*stride
+void
+sp_pyramid_feed (sp_pyramid_t *p, const sp_sample_t *in, int stride, int n);
+
+// Copy the size samples of one channel and level centered on input frame
+// center. Samples that were never produced read as silence.
+void
+sp_pyramid_read (const sp_pyramid_t *p, int level, int channel, uint64_t center, sp_sample_t *out);
+
+#endif // __SP_PYRAMID_H
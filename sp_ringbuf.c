@@ -0,0 +1,118 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sp_ringbuf.h"
+#include "sp_simd.h"
+
+int
+sp_ringbuf_init (sp_ringbuf_t *rb, int channels, uint32_t size)
+{
+    uint32_t sz = 1;
+    while (sz < size) {
+        sz <<= 1;
+    }
+    memset (rb, 0, sizeof (sp_ringbuf_t));
+    rb->planes = calloc ((size_t)channels * sz, sizeof (sp_sample_t));
+    if (!rb->planes) {
+        return -1;
+    }
+    rb->channels = channels;
+    rb->size = sz;
+    rb->mask = sz - 1;
+    return 0;
+}
+
+void
+sp_ringbuf_free (sp_ringbuf_t *rb)
+{
+    if (rb->planes) {
+        free (rb->planes);
+        rb->planes = NULL;
+    }
+}
+
+void
+sp_ringbuf_write (sp_ringbuf_t *rb, const float *data, int nframes, int channels, const int *map, int lanes)
+{
+    // only the producer modifies write_pos, a relaxed load is enough
+    uint64_t pos = __atomic_load_n (&rb->write_pos, __ATOMIC_RELAXED);
+
+    // older frames would be overwritten within this very call anyway
+    if ((uint32_t)nframes > rb->size) {
+        data += (size_t)(nframes - rb->size) * channels;
+        pos += nframes - rb->size;
+        nframes = rb->size;
+    }
+    if (lanes > rb->channels) {
+        lanes = rb->channels;
+    }
+
+    // announce the range we are about to overwrite before touching it
+    __atomic_store_n (&rb->write_end, pos + nframes, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    // All lanes in one pass over the input, in at most two contiguous chunks
+    uint32_t idx = (uint32_t)pos & rb->mask;
+    uint32_t first = rb->size - idx;
+    if (first > (uint32_t)nframes) {
+        first = nframes;
+    }
+    sp_simd_deinterleave (data, channels, map, lanes, rb->planes + idx, rb->size, first);
+    sp_simd_deinterleave (data + (size_t)first * channels, channels, map, lanes, rb->planes, rb->size, nframes - first);
+
+    __atomic_store_n (&rb->write_pos, pos + nframes, __ATOMIC_RELEASE);
+}
+
+uint64_t
+sp_ringbuf_write_pos (const sp_ringbuf_t *rb)
+{
+    return __atomic_load_n (&rb->write_pos, __ATOMIC_ACQUIRE);
+}
+
+int
+sp_ringbuf_read (const sp_ringbuf_t *rb, int channel, uint64_t end, int n, sp_sample_t *out)
+{
+    const sp_sample_t *plane = rb->planes + (size_t)channel * rb->size;
+
+    if (end < (uint64_t)n) {
+        int pad = n - (int)end;
+        memset (out, 0, pad * sizeof (sp_sample_t));
+        out += pad;
+        n = (int)end;
+    }
+    uint64_t start = end - n;
+
+    // at most two contiguous chunks
+    uint32_t idx = (uint32_t)start & rb->mask;
+    uint32_t first = rb->size - idx;
+    if (first > (uint32_t)n) {
+        first = n;
+    }
+    memcpy (out, plane + idx, first * sizeof (sp_sample_t));
+    memcpy (out + first, plane, (n - first) * sizeof (sp_sample_t));
+
+    // the producer may have lapped us while we were copying
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    uint64_t now = __atomic_load_n (&rb->write_end, __ATOMIC_RELAXED);
+    return now - start <= rb->size;
+}
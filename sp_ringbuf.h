@@ -0,0 +1,71 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Single producer / single consumer audio ring buffer.
+
+    The producer (audio thread) deinterleaves incoming frames into one plane
+    per channel and publishes them by advancing a monotonic 64 bit frame
+    counter; it never waits for the consumer. The consumer (analysis side)
+    does not consume anything, it copies out the window of frames it is
+    interested in and afterwards checks whether the producer lapped it while
+    copying, in which case the copy has to be retried or skipped.
+*/
+
+#ifndef __SP_RINGBUF_H
+#define __SP_RINGBUF_H
+
+#include <stdint.h>
+
+#include "sp_fft.h"
+
+typedef struct {
+    sp_sample_t *planes;     // channels * size samples, one plane per channel
+    int channels;
+    uint32_t size;      // power of two
+    uint32_t mask;
+    uint64_t write_pos; // total frames written, accessed atomically
+    uint64_t write_end; // end of the block currently being written
+} sp_ringbuf_t;
+
+// size is rounded up to the next power of two
+int
+sp_ringbuf_init (sp_ringbuf_t *rb, int channels, uint32_t size);
+
+void
+sp_ringbuf_free (sp_ringbuf_t *rb);
+
+// Producer side. Plane i < lanes takes channel map[i] of the interleaved
+// source, or channel i if map is NULL; channels the source does not have
+// are filled with silence. Planes from lanes on are left alone.
+void
+sp_ringbuf_write (sp_ringbuf_t *rb, const float *data, int nframes, int channels, const int *map, int lanes);
+
+// Consumer side: number of frames written so far
+uint64_t
+sp_ringbuf_write_pos (const sp_ringbuf_t *rb);
+
+// Copy the n frames preceding end (exclusive) of one channel into out.
+// Frames before the start of the stream read as silence.
+// Returns 0 if the producer overwrote part of the window during the copy.
+int
+sp_ringbuf_read (const sp_ringbuf_t *rb, int channel, uint64_t end, int n, sp_sample_t *out);
+
+#endif // __SP_RINGBUF_H
@@ -0,0 +1,276 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "sp_rowmap.h"
+#include "fastftoi.h"
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef CLAMP
+#define CLAMP(x,lo,hi) (((x) > (hi)) ? (hi) : (((x) < (lo)) ? (lo) : (x)))
+#endif
+
+void
+sp_rowmap_init (sp_rowmap_t *m)
+{
+    memset (m, 0, sizeof (sp_rowmap_t));
+}
+
+void
+sp_rowmap_free (sp_rowmap_t *m)
+{
+    free (m->lo);
+    free (m->hi);
+    free (m->interp_bin);
+    free (m->interp_mu);
+    sp_rowmap_init (m);
+}
+
+static int
+rowmap_reserve (sp_rowmap_t *m, int rows)
+{
+    if (m->capacity >= rows) {
+        return 1;
+    }
+    free (m->lo);
+    free (m->hi);
+    free (m->interp_bin);
+    free (m->interp_mu);
+    m->lo = malloc (sizeof (int) * rows);
+    m->hi = malloc (sizeof (int) * rows);
+    m->interp_bin = malloc (sizeof (int) * rows);
+    m->interp_mu = malloc (sizeof (float) * rows);
+    if (!m->lo || !m->hi || !m->interp_bin || !m->interp_mu) {
+        sp_rowmap_free (m);
+        return 0;
+    }
+    m->capacity = rows;
+    return 1;
+}
+
+int
+sp_rowmap_update (sp_rowmap_t *m, int rows, int ref_rows, float samplerate, int fft_size, int log_scale)
+{
+    if (m->capacity > 0 && rows == m->rows && ref_rows == m->ref_rows && samplerate == m->samplerate
+            && fft_size == m->fft_size && log_scale == m->log_scale) {
+        return 1;
+    }
+    m->rows = 0;
+    if (rows < 1 || ref_rows < 1 || !rowmap_reserve (m, rows)) {
+        return 0;
+    }
+    int *log_index = malloc (sizeof (int) * ref_rows);
+    if (!log_index) {
+        return 0;
+    }
+
+    // First bin of every row on a log scale from 25 Hz to nyquist
+    const float log_step = (log2f (samplerate/2)-log2f (25.))/ref_rows;
+    const float freq_res = samplerate / fft_size;
+    int low_res_end = 0;
+    for (int i = 0; i < ref_rows; i++) {
+        log_index[i] = ftoi (powf (2.,((float)i) * log_step + log2f (25.)) / freq_res);
+        if (i > 0 && log_index[i-1] == log_index[i]) {
+            low_res_end = i;
+        }
+    }
+    const int last_bin = fft_size/2-1;
+    const int ratio = CLAMP (fft_size/(ref_rows*2), 0, 1023);
+
+    for (int i = 0; i < rows; i++) {
+        int bin0, bin1, bin2;
+        if (log_scale) {
+            // Scale log_index to lane height
+            int scaled_i = (i * ref_rows) / rows;
+            bin0 = log_index[CLAMP (scaled_i-1, 0, ref_rows-1)];
+            bin1 = log_index[CLAMP (scaled_i, 0, ref_rows-1)];
+            bin2 = log_index[CLAMP (scaled_i+1, 0, ref_rows-1)];
+        }
+        else if (ratio > 0) {
+            bin0 = (i-1) * ratio;
+            bin1 = i * ratio;
+            bin2 = (i+1) * ratio;
+        }
+        else {
+            // more rows than bins, spread the bins over the rows
+            const float step = fft_size / (2.f * ref_rows);
+            bin0 = ftoi ((i-1) * step);
+            bin1 = ftoi (i * step);
+            bin2 = ftoi ((i+1) * step);
+        }
+
+        int index0 = bin0 + ftoi ((bin1 - bin0)/2.f);
+        if (index0 == bin0) index0 = bin1;
+        int index1 = bin1 + ftoi ((bin2 - bin1)/2.f);
+        if (index1 == bin2) index1 = bin1;
+
+        index0 = CLAMP (index0, 0, last_bin);
+        index1 = CLAMP (index1, 0, last_bin);
+
+        // an empty range stands for the single bin at its end
+        if (index0 >= index1) {
+            index0 = index1;
+            index1++;
+        }
+        m->lo[i] = index0;
+        m->hi[i] = index1;
+    }
+
+    // Rows below low_res_end share bins, blend each one towards the next
+    // distinct bin according to its position within the run
+    m->interp_rows = 0;
+    if (log_scale) {
+        m->interp_rows = MAX (0, (low_res_end * rows) / ref_rows + 1);
+        if (m->interp_rows > rows) {
+            m->interp_rows = rows;
+        }
+    }
+    for (int i = 0; i < m->interp_rows; i++) {
+        int scaled_i = (i * ref_rows) / rows;
+        int j = 0;
+        while (scaled_i+j < ref_rows && log_index[scaled_i+j] == log_index[scaled_i]) {
+            j++;
+        }
+        m->interp_bin[i] = scaled_i+j < ref_rows ? CLAMP (log_index[scaled_i+j], 0, last_bin) : -1;
+
+        int k = 0;
+        while ((k+scaled_i) >= 0 && log_index[k+scaled_i] == log_index[scaled_i]) {
+            j++;
+            k--;
+        }
+        m->interp_mu[i] = j > 1 ? (1.0/(j-1)) * ((-1 * k) - 1) : 0;
+    }
+    free (log_index);
+
+    m->rows = rows;
+    m->ref_rows = ref_rows;
+    m->samplerate = samplerate;
+    m->fft_size = fft_size;
+    m->log_scale = log_scale;
+    return 1;
+}
+
+float
+sp_rowmap_row (const sp_rowmap_t *m, float hz)
+{
+    if (m->rows < 1 || hz <= 0) {
+        return -1;
+    }
+    // inverse of the first bin per row chosen by sp_rowmap_update
+    if (m->log_scale) {
+        const float log_step = (log2f (m->samplerate/2)-log2f (25.))/m->ref_rows;
+        return (log2f (hz) - log2f (25.)) / log_step * m->rows / m->ref_rows;
+    }
+    const int ratio = CLAMP (m->fft_size/(m->ref_rows*2), 0, 1023);
+    const float step = ratio > 0 ? ratio : m->fft_size / (2.f * m->ref_rows);
+    return hz * m->fft_size / m->samplerate / step;
+}
+
+static inline sp_sample_t
+range_max (const sp_sample_t *p, int n)
+{
+    sp_sample_t value = p[0];
+    int i = 1;
+#if defined(__SSE2__) && !defined(SP_FFT_DOUBLE)
+    if (n >= 8) {
+        __m128 m0 = _mm_loadu_ps (p);
+        __m128 m1 = _mm_loadu_ps (p + 4);
+        for (i = 8; i + 8 <= n; i += 8) {
+            m0 = _mm_max_ps (m0, _mm_loadu_ps (p + i));
+            m1 = _mm_max_ps (m1, _mm_loadu_ps (p + i + 4));
+        }
+        m0 = _mm_max_ps (m0, m1);
+        m0 = _mm_max_ps (m0, _mm_movehl_ps (m0, m0));
+        m0 = _mm_max_ss (m0, _mm_shuffle_ps (m0, m0, 1));
+        value = _mm_cvtss_f32 (m0);
+    }
+#elif defined(__SSE2__)
+    if (n >= 4) {
+        __m128d m0 = _mm_loadu_pd (p);
+        __m128d m1 = _mm_loadu_pd (p + 2);
+        for (i = 4; i + 4 <= n; i += 4) {
+            m0 = _mm_max_pd (m0, _mm_loadu_pd (p + i));
+            m1 = _mm_max_pd (m1, _mm_loadu_pd (p + i + 2));
+        }
+        m0 = _mm_max_pd (m0, m1);
+        m0 = _mm_max_sd (m0, _mm_unpackhi_pd (m0, m0));
+        value = _mm_cvtsd_f64 (m0);
+    }
+#endif
+    for (; i < n; i++) {
+        value = MAX (p[i], value);
+    }
+    return value;
+}
+
+void
+sp_rowmap_reduce (const sp_rowmap_t *m, const sp_sample_t *power, float *out)
+{
+    const int *lo = m->lo;
+    const int *hi = m->hi;
+    for (int i = 0; i < m->rows; i++) {
+        out[i] = range_max (power + lo[i], hi[i] - lo[i]);
+    }
+}
+
+static inline uint8_t
+range_min_u8 (const uint8_t *p, int n)
+{
+    uint8_t value = p[0];
+    int i = 1;
+#if defined(__SSE2__)
+    if (n >= 16) {
+        __m128i m = _mm_loadu_si128 ((const __m128i *)p);
+        for (i = 16; i + 16 <= n; i += 16) {
+            m = _mm_min_epu8 (m, _mm_loadu_si128 ((const __m128i *)(p + i)));
+        }
+        m = _mm_min_epu8 (m, _mm_srli_si128 (m, 8));
+        m = _mm_min_epu8 (m, _mm_srli_si128 (m, 4));
+        m = _mm_min_epu8 (m, _mm_srli_si128 (m, 2));
+        m = _mm_min_epu8 (m, _mm_srli_si128 (m, 1));
+        value = (uint8_t)_mm_cvtsi128_si32 (m);
+    }
+#endif
+    for (; i < n; i++) {
+        value = MIN (p[i], value);
+    }
+    return value;
+}
+
+void
+sp_rowmap_reduce_levels (const sp_rowmap_t *m, const uint8_t *levels, float scale, float *out)
+{
+    const int *lo = m->lo;
+    const int *hi = m->hi;
+    for (int i = 0; i < m->rows; i++) {
+        out[i] = scale * range_min_u8 (levels + lo[i], hi[i] - lo[i]);
+    }
+}
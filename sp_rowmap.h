@@ -0,0 +1,78 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Mapping from display rows to FFT bins for one lane of the spectrogram.
+    Everything that only depends on the geometry (bin range per row, the
+    low frequency interpolation) is computed once per key, so rendering a
+    column is a straight pass over the table.
+*/
+
+#ifndef __SP_ROWMAP_H
+#define __SP_ROWMAP_H
+
+#include <stdint.h>
+
+#include "sp_fft.h"
+
+typedef struct {
+    // key
+    int rows;
+    int ref_rows;   // rows of the log_index table the lanes are scaled from
+    float samplerate;
+    int fft_size;
+    int log_scale;
+    // bins [lo, hi) are reduced to one value per row, hi > lo
+    int *lo;
+    int *hi;
+    // the lowest rows of a log scale map fewer bins than rows, they are
+    // interpolated towards interp_bin (-1 for 0 dB) by interp_mu
+    int interp_rows;
+    int *interp_bin;
+    float *interp_mu;
+    int capacity;
+} sp_rowmap_t;
+
+void
+sp_rowmap_init (sp_rowmap_t *m);
+
+void
+sp_rowmap_free (sp_rowmap_t *m);
+
+// Rebuild the table if any part of the key changed. Returns 0 on failure.
+int
+sp_rowmap_update (sp_rowmap_t *m, int rows, int ref_rows, float samplerate, int fft_size, int log_scale);
+
+// Row the table shows frequency hz in, counting from the bottom and with
+// a fraction, rows are centered on whole numbers; outside of -0.5 ..
+// rows-0.5 if it isn't shown
+float
+sp_rowmap_row (const sp_rowmap_t *m, float hz);
+
+// Maximum power over each row's bin range, rows values written to out
+void
+sp_rowmap_reduce (const sp_rowmap_t *m, const sp_sample_t *power, float *out);
+
+// Same for quantized levels (sp_level.h), where the loudest is the lowest:
+// minimum level over each row's bin range times scale
+void
+sp_rowmap_reduce_levels (const sp_rowmap_t *m, const uint8_t *levels, float scale, float *out);
+
+#endif // __SP_ROWMAP_H
@@ -0,0 +1,157 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <math.h>
+
+#include "sp_simd.h"
+
+void
+sp_simd_log2_affine (const float *in, float *out, int n, float a, float b)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i mant_mask = _mm_set1_epi32 (0x007fffff);
+    const __m128i one_bits = _mm_set1_epi32 (0x3f800000);
+    const __m128i bias = _mm_set1_epi32 (127);
+    const __m128 one = _mm_set1_ps (1.0f);
+    const __m128 c1 = _mm_set1_ps (1.4407808f);
+    const __m128 c2 = _mm_set1_ps (-0.683450254f);
+    const __m128 c3 = _mm_set1_ps (0.324285202f);
+    const __m128 c4 = _mm_set1_ps (-0.0816157439f);
+    const __m128 va = _mm_set1_ps (a);
+    const __m128 vb = _mm_set1_ps (b);
+    for (; i + 4 <= n; i += 4) {
+        __m128i bits = _mm_castps_si128 (_mm_loadu_ps (in + i));
+        __m128 e = _mm_cvtepi32_ps (_mm_sub_epi32 (_mm_srli_epi32 (bits, 23), bias));
+        __m128 t = _mm_sub_ps (_mm_castsi128_ps (_mm_or_si128 (_mm_and_si128 (bits, mant_mask), one_bits)), one);
+        __m128 p = _mm_add_ps (c3, _mm_mul_ps (t, c4));
+        p = _mm_add_ps (c2, _mm_mul_ps (t, p));
+        p = _mm_add_ps (c1, _mm_mul_ps (t, p));
+        __m128 l = _mm_add_ps (e, _mm_mul_ps (t, p));
+        _mm_storeu_ps (out + i, _mm_add_ps (_mm_mul_ps (va, l), vb));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = a * sp_fast_log2f (in[i]) + b;
+    }
+}
+
+void
+sp_simd_to_index (const float *in, int32_t *out, int n, int32_t max)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    // clamping before the conversion also keeps NaN and inf out of it
+    const __m128 lo = _mm_setzero_ps ();
+    const __m128 hi = _mm_set1_ps ((float)max);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_min_ps (_mm_max_ps (_mm_loadu_ps (in + i), lo), hi);
+        _mm_storeu_si128 ((__m128i *)(out + i), _mm_cvtps_epi32 (v));
+    }
+#endif
+    for (; i < n; i++) {
+        float v = in[i] > 0.0f ? in[i] : 0.0f;
+        out[i] = (int32_t)lrintf (v < max ? v : (float)max);
+    }
+}
+
+void
+sp_simd_deinterleave (const float *in, int channels, const int *map, int lanes,
+                      sp_sample_t *out, size_t plane_size, int n)
+{
+    const int identity = !map || (lanes <= 2 && map[0] == 0 && (lanes < 2 || map[1] == 1));
+    if (identity && channels == 1 && lanes == 1) {
+        for (int i = 0; i < n; i++) {
+            out[i] = in[i];
+        }
+        return;
+    }
+    if (!identity || channels != 2 || lanes != 2) {
+        for (int i = 0; i < n; i++, in += channels) {
+            for (int c = 0; c < lanes; c++) {
+                int src = map ? map[c] : c;
+                out[c * plane_size + i] = src >= 0 && src < channels ? in[src] : 0;
+            }
+        }
+        return;
+    }
+
+    // Stereo, by far the most common: four frames at a time
+    sp_sample_t *left = out;
+    sp_sample_t *right = out + plane_size;
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps (in + 2*i);
+        __m128 b = _mm_loadu_ps (in + 2*i + 4);
+        __m128 l = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+        __m128 r = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+#ifdef SP_FFT_DOUBLE
+        _mm_storeu_pd (left + i, _mm_cvtps_pd (l));
+        _mm_storeu_pd (left + i + 2, _mm_cvtps_pd (_mm_movehl_ps (l, l)));
+        _mm_storeu_pd (right + i, _mm_cvtps_pd (r));
+        _mm_storeu_pd (right + i + 2, _mm_cvtps_pd (_mm_movehl_ps (r, r)));
+#else
+        _mm_storeu_ps (left + i, l);
+        _mm_storeu_ps (right + i, r);
+#endif
+    }
+#endif
+    for (; i < n; i++) {
+        left[i] = in[2*i];
+        right[i] = in[2*i + 1];
+    }
+}
+
+void
+sp_simd_window_complex (const sp_sample_t *x0, const sp_sample_t *x1, const sp_sample_t *window,
+                        sp_fft_complex *in, int n)
+{
+    sp_sample_t *dst = (sp_sample_t *)in;
+    int i = 0;
+#if defined(__SSE2__)
+#ifdef SP_FFT_DOUBLE
+    const __m128d zero = _mm_setzero_pd ();
+    for (; i + 2 <= n; i += 2) {
+        __m128d w = _mm_loadu_pd (window + i);
+        __m128d re = _mm_mul_pd (_mm_loadu_pd (x0 + i), w);
+        __m128d im = x1 ? _mm_mul_pd (_mm_loadu_pd (x1 + i), w) : zero;
+        _mm_storeu_pd (dst + 2*i, _mm_unpacklo_pd (re, im));
+        _mm_storeu_pd (dst + 2*i + 2, _mm_unpackhi_pd (re, im));
+    }
+#else
+    const __m128 zero = _mm_setzero_ps ();
+    for (; i + 4 <= n; i += 4) {
+        __m128 w = _mm_loadu_ps (window + i);
+        __m128 re = _mm_mul_ps (_mm_loadu_ps (x0 + i), w);
+        __m128 im = x1 ? _mm_mul_ps (_mm_loadu_ps (x1 + i), w) : zero;
+        _mm_storeu_ps (dst + 2*i, _mm_unpacklo_ps (re, im));
+        _mm_storeu_ps (dst + 2*i + 4, _mm_unpackhi_ps (re, im));
+    }
+#endif
+#endif
+    for (; i < n; i++) {
+        dst[2*i] = x0[i] * window[i];
+        dst[2*i + 1] = x1 ? x1[i] * window[i] : 0;
+    }
+}
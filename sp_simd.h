@@ -0,0 +1,74 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Vector kernels of the ingest, analysis and render paths. SSE2 when the
+    compiler targets it (always the case on x86_64), plain C otherwise; both
+    paths compute the same approximations, so the output does not depend on
+    the build.
+*/
+
+#ifndef __SP_SIMD_H
+#define __SP_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sp_fft.h"
+
+// log2 (x) from the float's exponent plus a degree 4 polynomial in the
+// mantissa, absolute error below 0.0004 (about 0.001 dB). 0 maps to -127.
+static inline float
+sp_fast_log2f (float x)
+{
+    uint32_t bits;
+    memcpy (&bits, &x, sizeof (bits));
+    float e = (float)((int32_t)(bits >> 23) - 127);
+    bits = (bits & 0x007fffff) | 0x3f800000;
+    float t;
+    memcpy (&t, &bits, sizeof (t));
+    t -= 1.0f;
+    return e + t * (1.4407808f + t * (-0.683450254f + t * (0.324285202f + t * -0.0816157439f)));
+}
+
+// out[i] = a * log2 (in[i]) + b for non-negative in, may work in place
+void
+sp_simd_log2_affine (const float *in, float *out, int n, float a, float b);
+
+// Round to the nearest integer and clamp to [0, max]
+void
+sp_simd_to_index (const float *in, int32_t *out, int n, int32_t max);
+
+// Split n frames of interleaved float input with channels channels into
+// lanes planes of the analysis sample type, in one pass over the input:
+// out[c*plane_size + i] = in[i*channels + map[c]] (map NULL: map[c] = c),
+// silence where map[c] is not a channel of the input
+void
+sp_simd_deinterleave (const float *in, int channels, const int *map, int lanes,
+                      sp_sample_t *out, size_t plane_size, int n);
+
+// Window two lanes into the complex FFT input, x0 as the real and x1 as
+// the imaginary part; x1 NULL leaves the imaginary part 0
+void
+sp_simd_window_complex (const sp_sample_t *x0, const sp_sample_t *x1, const sp_sample_t *window,
+                        sp_fft_complex *in, int n);
+
+#endif // __SP_SIMD_H
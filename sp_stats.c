@@ -0,0 +1,122 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sp_stats.h"
+
+const char *sp_stat_timer_names[SP_STAT_TIMER_COUNT] = {
+    "ingest",
+    "fft",
+    "render",
+    "lock_wait",
+    "draw",
+    "blit",
+};
+
+const char *sp_stat_counter_names[SP_STAT_COUNTER_COUNT] = {
+    "dropped",
+    "lagged",
+    "lapped",
+    "late",
+    "missed_wakeup",
+};
+
+uint64_t
+sp_stats_now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+sp_stats_add_time (sp_stats_t *st, int timer, uint64_t ns)
+{
+    sp_stat_timer_t *t = &st->timers[timer];
+    uint64_t count = __atomic_load_n (&t->count, __ATOMIC_RELAXED);
+    uint32_t v = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+    __atomic_store_n (&t->samples[count % SP_STATS_WINDOW], v, __ATOMIC_RELAXED);
+    __atomic_store_n (&t->count, count + 1, __ATOMIC_RELEASE);
+}
+
+void
+sp_stats_add_count (sp_stats_t *st, int counter, uint64_t n)
+{
+    __atomic_fetch_add (&st->counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void
+sp_stats_reset (sp_stats_t *st)
+{
+    // Timers are only restarted from the reader's point of view, writers
+    // keep going. A sample landing during the reset may survive it.
+    for (int i = 0; i < SP_STAT_TIMER_COUNT; i++) {
+        __atomic_store_n (&st->timers[i].count, 0, __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < SP_STAT_COUNTER_COUNT; i++) {
+        __atomic_store_n (&st->counters[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+static int
+cmp_u32 (const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+void
+sp_stats_summary (const sp_stats_t *st, sp_stat_summary_t *timers, uint64_t *counters)
+{
+    uint32_t window[SP_STATS_WINDOW];
+
+    for (int i = 0; i < SP_STAT_TIMER_COUNT; i++) {
+        const sp_stat_timer_t *t = &st->timers[i];
+        sp_stat_summary_t *sum = &timers[i];
+        memset (sum, 0, sizeof (sp_stat_summary_t));
+
+        uint64_t count = __atomic_load_n (&t->count, __ATOMIC_ACQUIRE);
+        int n = count < SP_STATS_WINDOW ? (int)count : SP_STATS_WINDOW;
+        sum->count = count;
+        if (!n) {
+            continue;
+        }
+        for (int j = 0; j < n; j++) {
+            window[j] = __atomic_load_n (&t->samples[j], __ATOMIC_RELAXED);
+        }
+        qsort (window, n, sizeof (uint32_t), cmp_u32);
+
+        double total = 0;
+        for (int j = 0; j < n; j++) {
+            total += window[j];
+        }
+        sum->min_us = window[0] / 1000.0;
+        sum->avg_us = total / n / 1000.0;
+        sum->p99_us = window[(n * 99 + 99) / 100 - 1] / 1000.0;
+        sum->max_us = window[n-1] / 1000.0;
+    }
+    for (int i = 0; i < SP_STAT_COUNTER_COUNT; i++) {
+        counters[i] = __atomic_load_n (&st->counters[i], __ATOMIC_RELAXED);
+    }
+}
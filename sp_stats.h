@@ -0,0 +1,71 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Lightweight timing counters for the hot paths. Every timer has exactly
+    one writing thread and keeps its most recent samples in a small ring,
+    readers take a snapshot without locking. While disabled nothing but a
+    flag is checked, so the clock is not even read.
+*/
+
+#ifndef __SP_STATS_H
+#define __SP_STATS_H
+
+#include <stdint.h>
+
+#include "sp_core.h"
+
+// samples kept per timer for the percentiles
+#define SP_STATS_WINDOW 1024
+
+typedef struct {
+    uint32_t samples[SP_STATS_WINDOW]; // ns
+    uint64_t count;
+} sp_stat_timer_t;
+
+typedef struct {
+    int enabled;
+    sp_stat_timer_t timers[SP_STAT_TIMER_COUNT];
+    uint64_t counters[SP_STAT_COUNTER_COUNT];
+} sp_stats_t;
+
+uint64_t
+sp_stats_now (void);
+
+static inline int
+sp_stats_enabled (const sp_stats_t *st)
+{
+    return __atomic_load_n (&st->enabled, __ATOMIC_RELAXED);
+}
+
+// Only the timer's own thread may call this
+void
+sp_stats_add_time (sp_stats_t *st, int timer, uint64_t ns);
+
+void
+sp_stats_add_count (sp_stats_t *st, int counter, uint64_t n);
+
+void
+sp_stats_reset (sp_stats_t *st);
+
+void
+sp_stats_summary (const sp_stats_t *st, sp_stat_summary_t *timers, uint64_t *counters);
+
+#endif // __SP_STATS_H
@@ -26,19 +26,23 @@
 #include <math.h>
 #include <fcntl.h>
 #include <gtk/gtk.h>
-#include <fftw3.h>
 
 #include <deadbeef/deadbeef.h>
 #include <deadbeef/gtkui_api.h>
 
-#include "fastftoi.h"
-
-#define GRADIENT_TABLE_SIZE 2048
-#define FFT_SIZE 8192
-#define MAX_HEIGHT 4096
+#include "sp_core.h"
 
 #define     CONFSTR_SP_LOG_SCALE              "spectrogram.log_scale"
 #define     CONFSTR_SP_REFRESH_INTERVAL       "spectrogram.refresh_interval"
+#define     CONFSTR_SP_HOP_SIZE               "spectrogram.hop_size"
+#define     CONFSTR_SP_FFT_SIZE               "spectrogram.fft_size"
+#define     CONFSTR_SP_WINDOW                 "spectrogram.window"
+#define     CONFSTR_SP_FFT_PLANNER            "spectrogram.fft_planner"
+#define     CONFSTR_SP_STATS_DUMP_INTERVAL    "spectrogram.stats_dump_interval"
+#define     CONFSTR_SP_HISTORY_SIZE           "spectrogram.history_size"
+#define     CONFSTR_SP_MULTIRES               "spectrogram.multires"
+#define     CONFSTR_SP_MAX_BANDWIDTH          "spectrogram.max_bandwidth"
+#define     CONFSTR_SP_CHANNELS               "spectrogram.channels"
 #define     CONFSTR_SP_DB_RANGE               "spectrogram.db_range"
 #define     CONFSTR_SP_NUM_COLORS             "spectrogram.num_colors"
 #define     CONFSTR_SP_COLOR_GRADIENT_00      "spectrogram.color.gradient_00"
@@ -59,39 +63,89 @@ typedef struct {
     GtkWidget *drawarea;
     GtkWidget *popup;
     GtkWidget *popup_item;
+    GtkWidget *stats_item;
+    GtkWidget *scale_item;
+    GtkWidget *lanes_item;
+    GtkWidget *lane_items[SP_LANES_COUNT];
+    // Update pacing: a timer at the refresh interval. With GTK3 it asks
+    // the frame clock for a single frame and the update runs from its
+    // tick, so it lines up with the display refresh.
     guint drawtimer;
-    // Stereo channel data
-    double *data_left;
-    double *data_right;
-    double window[FFT_SIZE];
-    // Stereo FFT inputs
-    double *in_left;
-    double *in_right;
-    // Stereo FFT outputs
-    fftw_complex *out_complex_left;
-    fftw_complex *out_complex_right;
-    // Stereo FFT plans
-    fftw_plan p_r2c_left;
-    fftw_plan p_r2c_right;
-    uint32_t colors[GRADIENT_TABLE_SIZE];
-    // Stereo sample buffers
-    double *samples_left;
-    double *samples_right;
-    int *log_index;
-    float samplerate;
-    int height;
-    int low_res_end;
-    int resized;
-    int buffered;
-    intptr_t mutex;
+    guint tick;
+    // playback wants redraws
+    int playing;
+    // Visibility: mapped (not on a hidden tab), not covered by other
+    // windows and the toplevel not minimized. Nothing is analyzed or drawn
+    // while the widget can't be seen.
+    int mapped;
+    int obscured;
+    int iconified;
+    int visible;
+    gint64 hidden_since;
+    GtkWidget *toplevel;
+    gulong toplevel_handler;
+    // Instrumentation: overlay toggle, periodic JSON dump and the time of
+    // the last redraw to detect late frames
+    int show_stats;
+    guint statstimer;
+    // extent of the overlay box as last drawn
+    int stats_right;
+    int stats_bottom;
+    int serial;
+    gint64 last_draw;
+    // Headless analysis and render engine, following the shared analysis
+    // of source
+    sp_core_t *core;
+    struct spectrogram_source_s *source;
+    // Ring of columns, the next column is written at surf_cursor
     cairo_surface_t *surf;
+    int surf_cursor;
+    // set on seeks, the next redraw repaints the history from the cache
+    int refill;
+    // set when the whole view has to be rasterized again from the history
+    int redraw;
+    // columns the view is scrolled back from the newest one, 0 follows
+    // the playback
+    int scroll;
+    // SP_LANES_*, per widget and saved with the layout
+    int lane_mode;
+    // Frequency grid, lane labels and dB legend on top of the view, also
+    // saved with the layout. Drawn into a surface of its own only when
+    // the size, the layout of the view or the settings change, every
+    // redraw after that composites it in one go.
+    int show_scale;
+    cairo_surface_t *overlay;
+    // set by a change of colors, dB range or scale
+    int overlay_stale;
+    int overlay_lanes;
+    int overlay_lane_mode;
+    float overlay_samplerate;
+    int overlay_fft_size;
+    // width of the labels at the left and of the legend at the right edge
+    int overlay_left;
+    int overlay_right;
 } w_spectrogram_t;
 
+static const char *lane_mode_names[SP_LANES_COUNT] = {
+    "_L/R",
+    "_M/S",
+    "L/R + _correlation",
+};
+
 
 static int CONFIG_LOG_SCALE = 1;
 static int CONFIG_DB_RANGE = 70;
 static int CONFIG_NUM_COLORS = 7;
 static int CONFIG_REFRESH_INTERVAL = 25;
+static int CONFIG_HOP_SIZE = 1024;
+static int CONFIG_FFT_SIZE = SP_DEFAULT_FFT_SIZE;
+static int CONFIG_WINDOW = SP_WINDOW_BLACKMAN_HARRIS;
+static int CONFIG_FFT_PLANNER = SP_PLANNER_MEASURE;
+static int CONFIG_STATS_DUMP_INTERVAL = 0;
+static int CONFIG_HISTORY_SIZE = 32;
+static int CONFIG_MULTIRES = 0;
+static int CONFIG_MAX_BANDWIDTH = 0;
+static char CONFIG_CHANNELS[100];
 static GdkColor CONFIG_GRADIENT_COLORS[7];
 
 static void
@@ -101,6 +155,15 @@ save_config (void)
     deadbeef->conf_set_int (CONFSTR_SP_DB_RANGE, CONFIG_DB_RANGE);
     deadbeef->conf_set_int (CONFSTR_SP_NUM_COLORS, CONFIG_NUM_COLORS);
     deadbeef->conf_set_int (CONFSTR_SP_REFRESH_INTERVAL, CONFIG_REFRESH_INTERVAL);
+    deadbeef->conf_set_int (CONFSTR_SP_HOP_SIZE, CONFIG_HOP_SIZE);
+    deadbeef->conf_set_int (CONFSTR_SP_FFT_SIZE, CONFIG_FFT_SIZE);
+    deadbeef->conf_set_int (CONFSTR_SP_WINDOW, CONFIG_WINDOW);
+    deadbeef->conf_set_int (CONFSTR_SP_FFT_PLANNER, CONFIG_FFT_PLANNER);
+    deadbeef->conf_set_int (CONFSTR_SP_STATS_DUMP_INTERVAL, CONFIG_STATS_DUMP_INTERVAL);
+    deadbeef->conf_set_int (CONFSTR_SP_HISTORY_SIZE, CONFIG_HISTORY_SIZE);
+    deadbeef->conf_set_int (CONFSTR_SP_MULTIRES, CONFIG_MULTIRES);
+    deadbeef->conf_set_int (CONFSTR_SP_MAX_BANDWIDTH, CONFIG_MAX_BANDWIDTH);
+    deadbeef->conf_set_str (CONFSTR_SP_CHANNELS, CONFIG_CHANNELS);
     char color[100];
     snprintf (color, sizeof (color), "%d %d %d", CONFIG_GRADIENT_COLORS[0].red, CONFIG_GRADIENT_COLORS[0].green, CONFIG_GRADIENT_COLORS[0].blue);
     deadbeef->conf_set_str (CONFSTR_SP_COLOR_GRADIENT_00, color);
@@ -126,6 +189,15 @@ load_config (void)
     CONFIG_DB_RANGE = deadbeef->conf_get_int (CONFSTR_SP_DB_RANGE,                 70);
     CONFIG_NUM_COLORS = deadbeef->conf_get_int (CONFSTR_SP_NUM_COLORS,              7);
     CONFIG_REFRESH_INTERVAL = deadbeef->conf_get_int (CONFSTR_SP_REFRESH_INTERVAL, 25);
+    CONFIG_HOP_SIZE = deadbeef->conf_get_int (CONFSTR_SP_HOP_SIZE,                1024);
+    CONFIG_FFT_SIZE = deadbeef->conf_get_int (CONFSTR_SP_FFT_SIZE,  SP_DEFAULT_FFT_SIZE);
+    CONFIG_WINDOW = deadbeef->conf_get_int (CONFSTR_SP_WINDOW, SP_WINDOW_BLACKMAN_HARRIS);
+    CONFIG_FFT_PLANNER = deadbeef->conf_get_int (CONFSTR_SP_FFT_PLANNER, SP_PLANNER_MEASURE);
+    CONFIG_STATS_DUMP_INTERVAL = deadbeef->conf_get_int (CONFSTR_SP_STATS_DUMP_INTERVAL, 0);
+    CONFIG_HISTORY_SIZE = deadbeef->conf_get_int (CONFSTR_SP_HISTORY_SIZE, 32);
+    CONFIG_MULTIRES = deadbeef->conf_get_int (CONFSTR_SP_MULTIRES, 0);
+    CONFIG_MAX_BANDWIDTH = deadbeef->conf_get_int (CONFSTR_SP_MAX_BANDWIDTH, 0);
+    snprintf (CONFIG_CHANNELS, sizeof (CONFIG_CHANNELS), "%s", deadbeef->conf_get_str_fast (CONFSTR_SP_CHANNELS, ""));
     const char *color;
     color = deadbeef->conf_get_str_fast (CONFSTR_SP_COLOR_GRADIENT_00,        "65535 0 0");
     sscanf (color, "%hd %hd %hd", &(CONFIG_GRADIENT_COLORS[0].red), &(CONFIG_GRADIENT_COLORS[0].green), &(CONFIG_GRADIENT_COLORS[0].blue));
@@ -144,101 +216,196 @@ load_config (void)
     deadbeef->conf_unlock ();
 }
 
-// Helper function to process FFT for a single channel
-static void
-process_channel_fft(w_spectrogram_t *w, double *samples, double *in, fftw_complex *out_complex, fftw_plan plan, double *data)
+// Per user directory for regenerable data, newly allocated
+static char *
+spectrogram_cache_dir (void)
 {
-    double real, imag;
-
-    for (int i = 0; i < FFT_SIZE; i++) {
-        in[i] = samples[i] * w->window[i];
+    char *dir = g_build_filename (g_get_user_cache_dir (), "deadbeef", "stereo_spectrogram", NULL);
+    if (g_mkdir_with_parents (dir, 0755) != 0) {
+        g_free (dir);
+        return NULL;
     }
-    
-    fftw_execute (plan);
-    
-    for (int i = 0; i < FFT_SIZE/2; i++) {
-        real = out_complex[i][0];
-        imag = out_complex[i][1];
-        data[i] = (real*real + imag*imag);
+    return dir;
+}
+
+static gboolean
+spectrogram_dump_stats_cb (gpointer user_data)
+{
+    w_spectrogram_t *w = user_data;
+    char *dir = spectrogram_cache_dir ();
+    if (dir && w->core) {
+        char name[32];
+        snprintf (name, sizeof (name), "stats-%d.json", w->serial);
+        char *path = g_build_filename (dir, name, NULL);
+        sp_core_stats_write_json (w->core, path);
+        g_free (path);
     }
+    g_free (dir);
+    return TRUE;
 }
 
-void
-do_fft (w_spectrogram_t *w)
+// Instrumentation runs while the overlay is shown or stats are dumped
+static void
+spectrogram_update_stats (w_spectrogram_t *w)
 {
-    if ((!w->samples_left || !w->samples_right) || w->buffered < FFT_SIZE/2) {
+    if (!w->core) {
         return;
     }
-    
-    deadbeef->mutex_lock (w->mutex);
-    
-    // Process left channel
-    process_channel_fft(w, w->samples_left, w->in_left, w->out_complex_left, w->p_r2c_left, w->data_left);
-    
-    // Process right channel
-    process_channel_fft(w, w->samples_right, w->in_right, w->out_complex_right, w->p_r2c_right, w->data_right);
-    
-    deadbeef->mutex_unlock (w->mutex);
+    sp_core_stats_enable (w->core, w->show_stats || CONFIG_STATS_DUMP_INTERVAL > 0);
+    if (w->statstimer) {
+        g_source_remove (w->statstimer);
+        w->statstimer = 0;
+    }
+    if (CONFIG_STATS_DUMP_INTERVAL > 0) {
+        w->statstimer = g_timeout_add_seconds (CONFIG_STATS_DUMP_INTERVAL, spectrogram_dump_stats_cb, w);
+    }
 }
 
-static inline void
-_draw_point (uint8_t *data, int stride, int x0, int y0, uint32_t color) {
-    uint32_t *ptr = (uint32_t*)&data[y0*stride+x0*4];
-    *ptr = color;
+// Analysis shared between the widgets: one core per distinct analysis
+// setup, fed by its own listener, and the widgets' cores follow it.
+// Only touched from the GTK thread.
+typedef struct spectrogram_source_s {
+    sp_core_t *core;
+    sp_config_t conf;
+    int refs;
+    struct spectrogram_source_s *next;
+} spectrogram_source_t;
+
+static spectrogram_source_t *sources;
+
+static void
+spectrogram_wavedata_listener (void *ctx, const ddb_audio_data_t *data) {
+    spectrogram_source_t *src = ctx;
+    sp_core_ingest_at (src->core, data->data, data->nframes, data->fmt->channels, data->fmt->samplerate,
+            deadbeef->streamer_get_playpos ());
 }
 
-/* based on Delphi function by Witold J.Janik */
-void
-create_gradient_table (gpointer user_data, GdkColor *colors, int num_colors)
+static spectrogram_source_t *
+spectrogram_source_acquire (const sp_config_t *conf)
 {
-    w_spectrogram_t *w = user_data;
-
-    num_colors -= 1;
+    spectrogram_source_t *src;
+    for (src = sources; src; src = src->next) {
+        if (sp_core_config_shares (&src->conf, conf)) {
+            src->refs++;
+            return src;
+        }
+    }
+    src = malloc (sizeof (spectrogram_source_t));
+    if (!src) {
+        return NULL;
+    }
+    memset (src, 0, sizeof (spectrogram_source_t));
+    src->core = sp_core_new ();
+    if (!src->core) {
+        free (src);
+        return NULL;
+    }
+    src->conf = *conf;
+    src->refs = 1;
+    sp_core_set_config (src->core, conf);
+    src->next = sources;
+    sources = src;
+    deadbeef->vis_waveform_listen (src, spectrogram_wavedata_listener);
+    return src;
+}
 
-    for (int i = 0; i < GRADIENT_TABLE_SIZE; i++) {
-        double position = (double)i/GRADIENT_TABLE_SIZE;
-        /* if position > 1 then we have repetition of colors it maybe useful    */
-        if (position > 1.0) {
-            if (position - ftoi (position) == 0.0) {
-                position = 1.0;
-            }
-            else {
-                position = position - ftoi (position);
-            }
+static void
+spectrogram_source_release (spectrogram_source_t *src)
+{
+    if (!src || --src->refs > 0) {
+        return;
+    }
+    for (spectrogram_source_t **p = &sources; *p; p = &(*p)->next) {
+        if (*p == src) {
+            *p = src->next;
+            break;
         }
+    }
+    // no more audio from here on
+    deadbeef->vis_waveform_unlisten (src);
+    sp_core_free (src->core);
+    free (src);
+}
 
-        double m= num_colors * position;
-        int n=(int)m; // integer of m
-        double f=m-n;  // fraction of m
+// Tell the engine which track is playing, so it can cache its columns
+static void
+spectrogram_set_track (w_spectrogram_t *w)
+{
+    if (!w->core) {
+        return;
+    }
+    DB_playItem_t *it = deadbeef->streamer_get_playing_track ();
+    if (!it) {
+        sp_core_set_track (w->core, NULL, 0);
+        return;
+    }
+    // subtracks of cue sheets share the URI
+    deadbeef->pl_lock ();
+    const char *uri = deadbeef->pl_find_meta (it, ":URI");
+    const char *track = deadbeef->pl_find_meta (it, "track");
+    char *key = uri ? g_strdup_printf ("%s#%s", uri, track ? track : "") : NULL;
+    deadbeef->pl_unlock ();
+    sp_core_set_track (w->core, key, deadbeef->pl_get_item_duration (it));
+    g_free (key);
+    deadbeef->pl_item_unref (it);
+}
 
-        w->colors[i] = 0xFF000000;
-        float scale = 255/65535.f;
-        if (num_colors == 0) {
-            w->colors[i] = ((uint32_t)(colors[0].red*scale) & 0xFF) << 16 |
-                ((uint32_t)(colors[0].green*scale) & 0xFF) << 8 |
-                ((uint32_t)(colors[0].blue*scale) & 0xFF) << 0;
-        }
-        else if (n < num_colors) {
-            w->colors[i] = ((uint32_t)((colors[n].red*scale) + f * ((colors[n+1].red*scale)-(colors[n].red*scale))) & 0xFF) << 16 |
-                ((uint32_t)((colors[n].green*scale) + f * ((colors[n+1].green*scale)-(colors[n].green*scale))) & 0xFF) << 8 |
-                ((uint32_t)((colors[n].blue*scale) + f * ((colors[n+1].blue*scale)-(colors[n].blue*scale))) & 0xFF) << 0;
-        }
-        else if (n == num_colors) {
-            w->colors[i] = ((uint32_t)(colors[n].red*scale) & 0xFF) << 16 |
-                ((uint32_t)(colors[n].green*scale) & 0xFF) << 8 |
-                ((uint32_t)(colors[n].blue*scale) & 0xFF) << 0;
-        }
-        else {
-            w->colors[i] = 0xFFFFFFFF;
+static void
+spectrogram_apply_config (w_spectrogram_t *w)
+{
+    if (!w->core) {
+        return;
+    }
+    sp_color_t colors[SP_MAX_COLORS];
+    for (int i = 0; i < SP_MAX_COLORS; i++) {
+        colors[i].red = CONFIG_GRADIENT_COLORS[i].red;
+        colors[i].green = CONFIG_GRADIENT_COLORS[i].green;
+        colors[i].blue = CONFIG_GRADIENT_COLORS[i].blue;
+    }
+    sp_core_set_gradient (w->core, colors, CONFIG_NUM_COLORS);
+
+    sp_config_t conf = {
+        .log_scale = CONFIG_LOG_SCALE,
+        .db_range = CONFIG_DB_RANGE,
+        .refresh_interval = CONFIG_REFRESH_INTERVAL,
+        .hop_size = CONFIG_HOP_SIZE,
+        .fft_size = CONFIG_FFT_SIZE,
+        .window = CONFIG_WINDOW,
+        .planner = CONFIG_FFT_PLANNER,
+        .history_size = CONFIG_HISTORY_SIZE,
+        .multires = CONFIG_MULTIRES,
+        .max_bandwidth = CONFIG_MAX_BANDWIDTH,
+        .channel_mask = sp_core_channel_mask (CONFIG_CHANNELS),
+        .lane_mode = w->lane_mode,
+    };
+    // Widgets with the same analysis settings share one analysis, the
+    // one set up for the old settings goes once nobody follows it
+    if (!w->source || !sp_core_config_shares (&w->source->conf, &conf)) {
+        spectrogram_source_t *src = spectrogram_source_acquire (&conf);
+        if (src) {
+            sp_core_follow (w->core, src->core);
+            spectrogram_source_release (w->source);
+            w->source = src;
+            spectrogram_set_track (w);
         }
     }
+    if (w->source) {
+        // settings the analysis doesn't depend on, like the refresh interval
+        w->source->conf = conf;
+        sp_core_set_config (w->source->core, &conf);
+    }
+    sp_core_set_config (w->core, &conf);
+    spectrogram_update_stats (w);
+    // recolor what is on screen
+    __atomic_store_n (&w->redraw, 1, __ATOMIC_RELEASE);
+    w->overlay_stale = 1;
 }
 
 static int
 on_config_changed (gpointer user_data, uintptr_t ctx)
 {
-    create_gradient_table (user_data, CONFIG_GRADIENT_COLORS, CONFIG_NUM_COLORS);
     load_config ();
+    spectrogram_apply_config (user_data);
     return 0;
 }
 
@@ -259,6 +426,12 @@ gtk_widget_get_allocation (GtkWidget *widget, GtkAllocation *allocation) {
 #define gtk_widget_set_can_default(widget, candefault) {if (candefault) GTK_WIDGET_SET_FLAGS (widget, GTK_CAN_DEFAULT); else GTK_WIDGET_UNSET_FLAGS(widget, GTK_CAN_DEFAULT);}
 #endif
 
+#if !GTK_CHECK_VERSION(2,24,0)
+#define GTK_COMBO_BOX_TEXT GTK_COMBO_BOX
+#define gtk_combo_box_text_new gtk_combo_box_new_text
+#define gtk_combo_box_text_append_text gtk_combo_box_append_text
+#endif
+
 static void
 on_button_config (GtkMenuItem *menuitem, gpointer user_data)
 {
@@ -281,8 +454,18 @@ on_button_config (GtkMenuItem *menuitem, gpointer user_data)
     GtkWidget *num_colors_label;
     GtkWidget *num_colors;
     GtkWidget *log_scale;
+    GtkWidget *multires;
     GtkWidget *db_range_label0;
     GtkWidget *db_range;
+    GtkWidget *hbox04;
+    GtkWidget *hop_size_label;
+    GtkWidget *hop_size;
+    GtkWidget *hbox05;
+    GtkWidget *fft_size_label;
+    GtkWidget *fft_size;
+    GtkWidget *hbox06;
+    GtkWidget *window_label;
+    GtkWidget *window;
     GtkWidget *dialog_action_area13;
     GtkWidget *applybutton1;
     GtkWidget *cancelbutton1;
@@ -390,10 +573,63 @@ on_button_config (GtkMenuItem *menuitem, gpointer user_data)
     gtk_widget_show (db_range);
     gtk_box_pack_start (GTK_BOX (hbox03), db_range, TRUE, TRUE, 0);
 
+    hbox04 = gtk_hbox_new (FALSE, 8);
+    gtk_widget_show (hbox04);
+    gtk_box_pack_start (GTK_BOX (vbox01), hbox04, FALSE, FALSE, 0);
+
+    hop_size_label = gtk_label_new (NULL);
+    gtk_label_set_markup (GTK_LABEL (hop_size_label),"Hop size (samples):");
+    gtk_widget_show (hop_size_label);
+    gtk_box_pack_start (GTK_BOX (hbox04), hop_size_label, FALSE, TRUE, 0);
+
+    hop_size = gtk_spin_button_new_with_range (64,8192,64);
+    gtk_widget_show (hop_size);
+    gtk_box_pack_start (GTK_BOX (hbox04), hop_size, TRUE, TRUE, 0);
+
+    hbox05 = gtk_hbox_new (FALSE, 8);
+    gtk_widget_show (hbox05);
+    gtk_box_pack_start (GTK_BOX (vbox01), hbox05, FALSE, FALSE, 0);
+
+    fft_size_label = gtk_label_new (NULL);
+    gtk_label_set_markup (GTK_LABEL (fft_size_label),"FFT size:");
+    gtk_widget_show (fft_size_label);
+    gtk_box_pack_start (GTK_BOX (hbox05), fft_size_label, FALSE, TRUE, 0);
+
+    fft_size = gtk_combo_box_text_new ();
+    for (int size = SP_MIN_FFT_SIZE; size <= SP_MAX_FFT_SIZE; size *= 2) {
+        char text[20];
+        snprintf (text, sizeof (text), "%d", size);
+        gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (fft_size), text);
+    }
+    gtk_widget_show (fft_size);
+    gtk_box_pack_start (GTK_BOX (hbox05), fft_size, TRUE, TRUE, 0);
+
+    hbox06 = gtk_hbox_new (FALSE, 8);
+    gtk_widget_show (hbox06);
+    gtk_box_pack_start (GTK_BOX (vbox01), hbox06, FALSE, FALSE, 0);
+
+    window_label = gtk_label_new (NULL);
+    gtk_label_set_markup (GTK_LABEL (window_label),"Window:");
+    gtk_widget_show (window_label);
+    gtk_box_pack_start (GTK_BOX (hbox06), window_label, FALSE, TRUE, 0);
+
+    // same order as the SP_WINDOW_* constants
+    window = gtk_combo_box_text_new ();
+    gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (window), "Blackman-Harris");
+    gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (window), "Hann");
+    gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (window), "Kaiser");
+    gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (window), "Flat top");
+    gtk_widget_show (window);
+    gtk_box_pack_start (GTK_BOX (hbox06), window, TRUE, TRUE, 0);
+
     log_scale = gtk_check_button_new_with_label ("Log scale");
     gtk_widget_show (log_scale);
     gtk_box_pack_start (GTK_BOX (vbox01), log_scale, FALSE, FALSE, 0);
 
+    multires = gtk_check_button_new_with_label ("Multi-resolution (with log scale)");
+    gtk_widget_show (multires);
+    gtk_box_pack_start (GTK_BOX (vbox01), multires, FALSE, FALSE, 0);
+
     dialog_action_area13 = gtk_dialog_get_action_area (GTK_DIALOG (spectrogram_properties));
     gtk_widget_show (dialog_action_area13);
     gtk_button_box_set_layout (GTK_BUTTON_BOX (dialog_action_area13), GTK_BUTTONBOX_END);
@@ -414,8 +650,16 @@ on_button_config (GtkMenuItem *menuitem, gpointer user_data)
     gtk_widget_set_can_default (okbutton1, TRUE);
 
     gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (log_scale), CONFIG_LOG_SCALE);
+    gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (multires), CONFIG_MULTIRES);
     gtk_spin_button_set_value (GTK_SPIN_BUTTON (num_colors), CONFIG_NUM_COLORS);
     gtk_spin_button_set_value (GTK_SPIN_BUTTON (db_range), CONFIG_DB_RANGE);
+    gtk_spin_button_set_value (GTK_SPIN_BUTTON (hop_size), CONFIG_HOP_SIZE);
+    int fft_size_index = 0;
+    while ((SP_MIN_FFT_SIZE << (fft_size_index+1)) <= CONFIG_FFT_SIZE && (SP_MIN_FFT_SIZE << (fft_size_index+1)) <= SP_MAX_FFT_SIZE) {
+        fft_size_index++;
+    }
+    gtk_combo_box_set_active (GTK_COMBO_BOX (fft_size), fft_size_index);
+    gtk_combo_box_set_active (GTK_COMBO_BOX (window), CLAMP (CONFIG_WINDOW, 0, SP_WINDOW_COUNT-1));
     gtk_color_button_set_color (GTK_COLOR_BUTTON (color_gradient_00), &(CONFIG_GRADIENT_COLORS[0]));
     gtk_color_button_set_color (GTK_COLOR_BUTTON (color_gradient_01), &(CONFIG_GRADIENT_COLORS[1]));
     gtk_color_button_set_color (GTK_COLOR_BUTTON (color_gradient_02), &(CONFIG_GRADIENT_COLORS[2]));
@@ -495,7 +739,11 @@ on_button_config (GtkMenuItem *menuitem, gpointer user_data)
             gtk_color_button_get_color (GTK_COLOR_BUTTON (color_gradient_06), &CONFIG_GRADIENT_COLORS[6]);
 
             CONFIG_LOG_SCALE = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (log_scale));
+            CONFIG_MULTIRES = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (multires));
             CONFIG_DB_RANGE = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (db_range));
+            CONFIG_HOP_SIZE = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (hop_size));
+            CONFIG_FFT_SIZE = SP_MIN_FFT_SIZE << gtk_combo_box_get_active (GTK_COMBO_BOX (fft_size));
+            CONFIG_WINDOW = gtk_combo_box_get_active (GTK_COMBO_BOX (window));
             CONFIG_NUM_COLORS = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (num_colors));
             switch (CONFIG_NUM_COLORS) {
                 case 1:
@@ -571,291 +819,475 @@ on_button_config (GtkMenuItem *menuitem, gpointer user_data)
 void
 w_spectrogram_destroy (ddb_gtkui_widget_t *w) {
     w_spectrogram_t *s = (w_spectrogram_t *)w;
-    deadbeef->vis_waveform_unlisten (w);
-    
-    // Free stereo data arrays
-    if (s->data_left) {
-        free (s->data_left);
-        s->data_left = NULL;
-    }
-    if (s->data_right) {
-        free (s->data_right);
-        s->data_right = NULL;
-    }
-    
-    // Free stereo sample arrays
-    if (s->samples_left) {
-        free (s->samples_left);
-        s->samples_left = NULL;
-    }
-    if (s->samples_right) {
-        free (s->samples_right);
-        s->samples_right = NULL;
-    }
-    
-    if (s->log_index) {
-        free (s->log_index);
-        s->log_index = NULL;
-    }
-    
-    // Destroy stereo FFT plans
-    if (s->p_r2c_left) {
-        fftw_destroy_plan (s->p_r2c_left);
-    }
-    if (s->p_r2c_right) {
-        fftw_destroy_plan (s->p_r2c_right);
-    }
-    
-    // Free stereo FFT input arrays
-    if (s->in_left) {
-        fftw_free (s->in_left);
-        s->in_left = NULL;
-    }
-    if (s->in_right) {
-        fftw_free (s->in_right);
-        s->in_right = NULL;
-    }
-    
-    // Free stereo FFT output arrays
-    if (s->out_complex_left) {
-        fftw_free (s->out_complex_left);
-        s->out_complex_left = NULL;
-    }
-    if (s->out_complex_right) {
-        fftw_free (s->out_complex_right);
-        s->out_complex_right = NULL;
-    }
-    
+    if (s->core) {
+        sp_core_free (s->core);
+        s->core = NULL;
+    }
+    spectrogram_source_release (s->source);
+    s->source = NULL;
     if (s->drawtimer) {
         g_source_remove (s->drawtimer);
         s->drawtimer = 0;
     }
+#if GTK_CHECK_VERSION(3,0,0)
+    if (s->tick) {
+        gtk_widget_remove_tick_callback (s->drawarea, s->tick);
+        s->tick = 0;
+    }
+#endif
+    if (s->toplevel_handler) {
+        g_signal_handler_disconnect (s->toplevel, s->toplevel_handler);
+        s->toplevel_handler = 0;
+    }
+    if (s->statstimer) {
+        g_source_remove (s->statstimer);
+        s->statstimer = 0;
+    }
     if (s->surf) {
         cairo_surface_destroy (s->surf);
         s->surf = NULL;
     }
-    if (s->mutex) {
-        deadbeef->mutex_free (s->mutex);
-        s->mutex = 0;
+    if (s->overlay) {
+        cairo_surface_destroy (s->overlay);
+        s->overlay = NULL;
     }
 }
 
-gboolean
-w_spectrogram_draw_cb (void *data) {
-    w_spectrogram_t *s = data;
-    gtk_widget_queue_draw (s->drawarea);
-    return TRUE;
-}
-
-// Forward declaration
-static void process_channel_samples(double *samples, const ddb_audio_data_t *data, int channel, int sz, int n, int nsamples);
-
+// Paint the part of the track behind the playhead from the cache, black
+// where it is unknown. The pending columns follow at the right edge. The
+// history starts over with the same columns, so redrawing from it later
+// shows the same.
 static void
-spectrogram_wavedata_listener (void *ctx, const ddb_audio_data_t *data) {
-    w_spectrogram_t *w = ctx;
-    if (!w->samples_left || !w->samples_right) {
-        return;
-    }
-    
-    deadbeef->mutex_lock (w->mutex);
-    w->samplerate = (float)data->fmt->samplerate;
-    int nsamples = data->nframes;
-    int sz = MIN (FFT_SIZE, nsamples);
-    int n = FFT_SIZE - sz;
-    
-    // Shift existing samples for both channels
-    memmove (w->samples_left, w->samples_left + sz, (FFT_SIZE - sz)*sizeof (double));
-    memmove (w->samples_right, w->samples_right + sz, (FFT_SIZE - sz)*sizeof (double));
-
-    // Process left channel (channel 0)
-    process_channel_samples(w->samples_left, data, 0, sz, n, nsamples);
-    
-    // Process right channel (channel 1)
-    process_channel_samples(w->samples_right, data, 1, sz, n, nsamples);
-    
-    deadbeef->mutex_unlock (w->mutex);
-    if (w->buffered < FFT_SIZE) {
-        w->buffered += sz;
+spectrogram_fill_from_cache (w_spectrogram_t *w, unsigned char *data, int stride, int width, int height)
+{
+    double time = deadbeef->streamer_get_playpos ();
+    int pending = MIN (sp_core_pending (w->core), width);
+    memset (data, 0, (size_t)stride * height);
+    sp_core_history_refill (w->core, time, pending, width - pending);
+    if (width > pending) {
+        sp_core_render_history (w->core, data, stride, width - pending, height, 0);
     }
+    cairo_surface_mark_dirty (w->surf);
+    w->surf_cursor = (width - pending) % width;
 }
 
-// Helper function to get value from specific channel data
-static inline float
-spectrogram_get_value_from_data (double *data, int start, int end)
+// Small text box with the hot path statistics in the top left corner
+static void
+spectrogram_draw_stats (w_spectrogram_t *w, cairo_t *cr)
 {
-    if (start >= end) {
-        return data[end];
+    sp_stat_summary_t timers[SP_STAT_TIMER_COUNT];
+    uint64_t counters[SP_STAT_COUNTER_COUNT];
+    sp_core_stats_summary (w->core, timers, counters);
+
+    char lines[SP_STAT_TIMER_COUNT + SP_STAT_COUNTER_COUNT + 1][64];
+    int n = 0;
+    snprintf (lines[n++], sizeof (lines[0]), "%-10s %8s %8s %8s", "us", "min", "avg", "p99");
+    for (int i = 0; i < SP_STAT_TIMER_COUNT; i++) {
+        snprintf (lines[n++], sizeof (lines[0]), "%-10s %8.1f %8.1f %8.1f", sp_stat_timer_names[i],
+                timers[i].min_us, timers[i].avg_us, timers[i].p99_us);
+    }
+    for (int i = 0; i < SP_STAT_COUNTER_COUNT; i++) {
+        snprintf (lines[n++], sizeof (lines[0]), "%-14s %8llu", sp_stat_counter_names[i], (unsigned long long)counters[i]);
     }
-    float value = 0.0;
-    for (int i = start; i < end; i++) {
-        value = MAX (data[i], value);
+
+    cairo_save (cr);
+    cairo_select_font_face (cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size (cr, 10);
+    cairo_text_extents_t ex;
+    cairo_text_extents (cr, lines[0], &ex);
+    const double line_height = 12;
+
+    cairo_set_source_rgba (cr, 0, 0, 0, 0.6);
+    cairo_rectangle (cr, 4, 4, ex.x_advance + 8, n * line_height + 6);
+    w->stats_right = 4 + ceil (ex.x_advance) + 8;
+    w->stats_bottom = 4 + n * line_height + 6;
+    cairo_fill (cr);
+    cairo_set_source_rgb (cr, 1, 1, 1);
+    for (int i = 0; i < n; i++) {
+        cairo_move_to (cr, 8, 4 + (i + 1) * line_height);
+        cairo_show_text (cr, lines[i]);
     }
-    return value;
+    cairo_restore (cr);
 }
 
-// Helper function to process samples for a single channel
-static void
-process_channel_samples(double *samples, const ddb_audio_data_t *data, int channel, int sz, int n, int nsamples)
+// Text with a dark outline so it reads on any color, x is the left or,
+// with align_right, the right end
+static double
+spectrogram_overlay_text (cairo_t *cr, double x, double y, const char *text, int align_right)
 {
-    float pos = 0;
-    for (int i = 0; i < sz && pos < nsamples; i++, pos++) {
-        int sample_idx = ftoi(pos * data->fmt->channels);
-        if (channel < data->fmt->channels) {
-            samples[n+i] = data->data[sample_idx + channel];
-        } else {
-            samples[n+i] = 0.0; // Fallback for mono input to stereo
-        }
+    cairo_text_extents_t ex;
+    cairo_text_extents (cr, text, &ex);
+    if (align_right) {
+        x -= ex.x_advance;
     }
+    cairo_move_to (cr, x, y);
+    cairo_text_path (cr, text);
+    cairo_set_source_rgba (cr, 0, 0, 0, 0.8);
+    cairo_set_line_width (cr, 2);
+    cairo_stroke_preserve (cr);
+    cairo_set_source_rgb (cr, 1, 1, 1);
+    cairo_fill (cr);
+    return ex.x_advance;
 }
 
-static inline float
-linear_interpolate (float y1, float y2, float mu)
+static const char *
+spectrogram_lane_label (w_spectrogram_t *w, int lane, int lanes, char *s, size_t size)
 {
-       return (y1 * (1 - mu) + y2 * mu);
+    if (lanes == 1) {
+        return "mono";
+    }
+    if (w->overlay_lane_mode == SP_LANES_LR_CORRELATION && lanes > 2 && lane == lanes - 1) {
+        return "corr";
+    }
+    if (lane < 2) {
+        if (w->overlay_lane_mode == SP_LANES_MS) {
+            return lane ? "S" : "M";
+        }
+        return lane ? "R" : "L";
+    }
+    snprintf (s, size, "ch %d", lane + 1);
+    return s;
 }
 
-// Helper function to render a single channel in specified vertical range
+// Hz gridlines and labels for every lane, dividers between the lanes and
+// the gradient as a dB legend at the right edge
 static void
-render_channel_spectrogram(w_spectrogram_t *w, double *channel_data, uint8_t *data, int stride, 
-                          int width, int y_start, int y_end, int ratio)
+spectrogram_draw_overlay (w_spectrogram_t *w, cairo_t *cr, int width, int height, int n)
 {
-    int channel_height = y_end - y_start;
-    
-    for (int i = 0; i < channel_height; i++) {
-        float f = 1.0;
-        int index0, index1;
-        int bin0, bin1, bin2;
-        
-        if (CONFIG_LOG_SCALE) {
-            // Scale log_index to channel height
-            int scaled_i = (i * w->height) / channel_height;
-            bin0 = w->log_index[CLAMP (scaled_i-1, 0, w->height-1)];
-            bin1 = w->log_index[CLAMP (scaled_i, 0, w->height-1)];
-            bin2 = w->log_index[CLAMP (scaled_i+1, 0, w->height-1)];
-        } else {
-            bin0 = (i-1) * ratio;
-            bin1 = i * ratio;
-            bin2 = (i+1) * ratio;
+    static const int log_grid[] = { 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000 };
+    static const int linear_steps[] = { 500, 1000, 2000, 5000, 10000, 20000 };
+    const double min_spacing = 14;
+    const int lane_height = height / n;
+
+    cairo_select_font_face (cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size (cr, 9);
+    cairo_set_line_width (cr, 1);
+
+    // With the linear scale the smallest step that keeps gridlines apart
+    int grid[64];
+    int grid_size = 0;
+    if (CONFIG_LOG_SCALE) {
+        memcpy (grid, log_grid, sizeof (log_grid));
+        grid_size = sizeof (log_grid) / sizeof (log_grid[0]);
+    }
+    else {
+        const float nyquist = w->overlay_samplerate / 2;
+        int step = linear_steps[0];
+        for (int i = 0; i < sizeof (linear_steps) / sizeof (linear_steps[0]); i++) {
+            step = linear_steps[i];
+            if (lane_height * step / nyquist >= 2 * min_spacing) {
+                break;
+            }
         }
+        for (int hz = step; hz < nyquist && grid_size < 64; hz += step) {
+            grid[grid_size++] = hz;
+        }
+    }
 
-        index0 = bin0 + ftoi ((bin1 - bin0)/2.f);
-        if (index0 == bin0) index0 = bin1;
-        index1 = bin1 + ftoi ((bin2 - bin1)/2.f);
-        if (index1 == bin2) index1 = bin1;
-
-        index0 = CLAMP (index0, 0, FFT_SIZE/2-1);
-        index1 = CLAMP (index1, 0, FFT_SIZE/2-1);
-
-        f = spectrogram_get_value_from_data (channel_data, index0, index1);
-        float x = 10 * log10f (f);
-
-        // Interpolation for log scale low resolution
-        if (CONFIG_LOG_SCALE && i <= (w->low_res_end * channel_height) / w->height) {
-            int j = 0;
-            int scaled_i = (i * w->height) / channel_height;
-            // Find index of next value
-            while (scaled_i+j < w->height && w->log_index[scaled_i+j] == w->log_index[scaled_i]) {
-                j++;
+    double left = 0;
+    char label[32];
+    for (int lane = 0; lane < n; lane++) {
+        const int top = lane * lane_height;
+        const int bottom = lane == n - 1 ? height : top + lane_height;
+        if (lane > 0) {
+            cairo_set_source_rgba (cr, 1, 1, 1, 0.5);
+            cairo_move_to (cr, 0, top + 0.5);
+            cairo_line_to (cr, width, top + 0.5);
+            cairo_stroke (cr);
+        }
+        // the lane label takes the top, frequencies too close to the
+        // previous label are left unlabeled
+        double last = top + 10;
+        for (int i = 0; i < grid_size; i++) {
+            int y = sp_core_freq_row (w->core, lane, grid[i]);
+            if (y < 0) {
+                continue;
             }
-            float v0 = x;
-            float v1 = 0;
-            if (scaled_i+j < w->height) {
-                v1 = channel_data[w->log_index[scaled_i+j]];
-                if (v1 != 0) {
-                    v1 = 10 * log10f (v1);
+            cairo_set_source_rgba (cr, 1, 1, 1, 0.2);
+            cairo_move_to (cr, 0, y + 0.5);
+            cairo_line_to (cr, width, y + 0.5);
+            cairo_stroke (cr);
+            if (last - y >= min_spacing && y - top >= min_spacing + 10 && bottom - y > 3) {
+                if (grid[i] < 1000) {
+                    snprintf (label, sizeof (label), "%d", grid[i]);
                 }
-            }
-
-            int k = 0;
-            while ((k+scaled_i) >= 0 && w->log_index[k+scaled_i] == w->log_index[scaled_i]) {
-                j++;
-                k--;
-            }
-            if (j > 1) {
-                x = linear_interpolate (v0, v1, (1.0/(j-1)) * ((-1 * k) - 1));
+                else {
+                    snprintf (label, sizeof (label), "%gk", grid[i] / 1000.);
+                }
+                left = MAX (left, spectrogram_overlay_text (cr, 3, y + 3, label, 0));
+                last = y;
             }
         }
+        const char *name = spectrogram_lane_label (w, lane, w->overlay_lanes, label, sizeof (label));
+        left = MAX (left, spectrogram_overlay_text (cr, 3, top + 12, name, 0));
+    }
+    w->overlay_left = 3 + ceil (left) + 2;
 
-        // Apply dB range and color mapping
-        x += CONFIG_DB_RANGE - 63;
-        x = CLAMP (x, 0, CONFIG_DB_RANGE);
-        int color_index = GRADIENT_TABLE_SIZE - ftoi (GRADIENT_TABLE_SIZE/(float)CONFIG_DB_RANGE * x);
-        color_index = CLAMP (color_index, 0, GRADIENT_TABLE_SIZE-1);
-        
-        // Draw pixel at proper position (invert y for bottom-to-top frequency display)
-        _draw_point (data, stride, width-1, y_end-1-i, w->colors[color_index]);
+    // Legend, the same gradient the levels are colored with, 0 dB at the top
+    if (height < 40) {
+        w->overlay_right = 0;
+        return;
+    }
+    const double bar_width = 6;
+    const double bar_x = width - 4 - bar_width;
+    const double bar_top = 14;
+    const double bar_bottom = height - 14;
+    cairo_pattern_t *pat = cairo_pattern_create_linear (0, bar_top, 0, bar_bottom);
+    for (int i = 0; i < CONFIG_NUM_COLORS; i++) {
+        const GdkColor *c = &CONFIG_GRADIENT_COLORS[i];
+        double offset = CONFIG_NUM_COLORS > 1 ? (double)i / (CONFIG_NUM_COLORS - 1) : 0;
+        cairo_pattern_add_color_stop_rgb (pat, offset, c->red / 65535., c->green / 65535., c->blue / 65535.);
     }
+    cairo_rectangle (cr, bar_x, bar_top, bar_width, bar_bottom - bar_top);
+    cairo_set_source (cr, pat);
+    cairo_fill_preserve (cr);
+    cairo_pattern_destroy (pat);
+    cairo_set_source_rgba (cr, 0, 0, 0, 0.8);
+    cairo_stroke (cr);
+
+    double right = spectrogram_overlay_text (cr, bar_x + bar_width, bar_top - 4, "0 dB", 1);
+    snprintf (label, sizeof (label), "-%d", CONFIG_DB_RANGE);
+    right = MAX (right, spectrogram_overlay_text (cr, bar_x + bar_width, bar_bottom + 11, label, 1));
+    w->overlay_right = 4 + MAX (bar_width, ceil (right)) + 2;
 }
 
-static gboolean
-spectrogram_draw (GtkWidget *widget, cairo_t *cr, gpointer user_data) {
-    w_spectrogram_t *w = user_data;
-    GtkAllocation a;
-    gtk_widget_get_allocation (widget, &a);
-    if (!w->samples_left || !w->samples_right || a.height < 2) {
-        return FALSE;
+// Draw the overlay again if anything it shows changed since the last time.
+// Returns nonzero if it did.
+static int
+spectrogram_update_overlay (w_spectrogram_t *w, int width, int height)
+{
+    int lanes = 0, fft_size = 0;
+    float samplerate = 0;
+    const int n = sp_core_view_layout (w->core, &lanes, &samplerate, &fft_size);
+    if (w->overlay
+            && !w->overlay_stale
+            && cairo_image_surface_get_width (w->overlay) == width
+            && cairo_image_surface_get_height (w->overlay) == height
+            && w->overlay_lanes == lanes
+            && w->overlay_lane_mode == w->lane_mode
+            && w->overlay_samplerate == samplerate
+            && w->overlay_fft_size == fft_size) {
+        return 0;
     }
-
-    int width, height;
-    width = a.width;
-    height = a.height;
-    int half_height = height / 2;
-    int ratio = ftoi (FFT_SIZE/(half_height*2));
-    ratio = CLAMP (ratio,0,1023);
-
-    if (deadbeef->get_output ()->state () == OUTPUT_STATE_PLAYING) {
-        do_fft (w);
-        float log_scale = (log2f(w->samplerate/2)-log2f(25.))/(half_height);
-        float freq_res = w->samplerate / FFT_SIZE;
-
-        if (half_height != w->height) {
-            w->height = MIN (half_height, MAX_HEIGHT);
-            for (int i = 0; i < w->height; i++) {
-                w->log_index[i] = ftoi (powf(2.,((float)i) * log_scale + log2f(25.)) / freq_res);
-                if (i > 0 && w->log_index[i-1] == w->log_index [i]) {
-                    w->low_res_end = i;
-                }
-            }
+    if (!w->overlay || cairo_image_surface_get_width (w->overlay) != width || cairo_image_surface_get_height (w->overlay) != height) {
+        if (w->overlay) {
+            cairo_surface_destroy (w->overlay);
         }
+        w->overlay = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+    }
+    w->overlay_stale = 0;
+    w->overlay_lanes = lanes;
+    w->overlay_lane_mode = w->lane_mode;
+    w->overlay_samplerate = samplerate;
+    w->overlay_fft_size = fft_size;
+    w->overlay_left = w->overlay_right = 0;
+
+    cairo_t *cr = cairo_create (w->overlay);
+    cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint (cr);
+    cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+    // nothing to label before the first column
+    if (n > 0 && height >= 2 * n) {
+        spectrogram_draw_overlay (w, cr, width, height, n);
     }
+    cairo_destroy (cr);
+    return 1;
+}
 
-    // start drawing
-    if (!w->surf || cairo_image_surface_get_width (w->surf) != a.width || cairo_image_surface_get_height (w->surf) != a.height) {
+// Repaint the whole surface where it has to be: after a resize, a seek or
+// a change of colors, scale or scroll position. Returns nonzero if it did.
+static int
+spectrogram_render_view (w_spectrogram_t *w, int width, int height)
+{
+    int redraw = __atomic_exchange_n (&w->redraw, 0, __ATOMIC_ACQ_REL);
+    if (!w->surf || cairo_image_surface_get_width (w->surf) != width || cairo_image_surface_get_height (w->surf) != height) {
         if (w->surf) {
             cairo_surface_destroy (w->surf);
             w->surf = NULL;
         }
-        w->surf = cairo_image_surface_create (CAIRO_FORMAT_RGB24, a.width, a.height);
+        w->surf = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+        w->surf_cursor = 0;
+        redraw = 1;
     }
-
     cairo_surface_flush (w->surf);
+    unsigned char *data = cairo_image_surface_get_data (w->surf);
+    if (!data) {
+        return 0;
+    }
+    int stride = cairo_image_surface_get_stride (w->surf);
 
+    if (__atomic_exchange_n (&w->refill, 0, __ATOMIC_ACQ_REL)) {
+        w->scroll = 0;
+        spectrogram_fill_from_cache (w, data, stride, width, height);
+        return 1;
+    }
+    if (redraw) {
+        sp_core_render_history (w->core, data, stride, width, height, w->scroll);
+        cairo_surface_mark_dirty (w->surf);
+        w->surf_cursor = 0;
+        return 1;
+    }
+    return 0;
+}
+
+// Render the pending columns into the surface. Returns the number of
+// columns that went to the right edge, or -1 if the whole view changed.
+static int
+spectrogram_render_columns (w_spectrogram_t *w, int width, int height)
+{
     unsigned char *data = cairo_image_surface_get_data (w->surf);
     if (!data) {
-        return FALSE;
+        return 0;
     }
     int stride = cairo_image_surface_get_stride (w->surf);
 
-    if (deadbeef->get_output ()->state () == OUTPUT_STATE_PLAYING) {
-        for (int i = 0; i < a.height; i++) {
-            // scrolling: move line i 1px to the left
-            memmove (data + (i*stride), data + sizeof (uint32_t) + (i*stride), stride - sizeof (uint32_t));
+    if (w->scroll > 0) {
+        // Looking back: new columns only go to the history and the view
+        // stays at the same point in time, until it would fall off the end
+        int n = 0;
+        while (sp_core_render_column (w->core, NULL, 0, 0, height)) {
+            n++;
+        }
+        int max_scroll = MAX (0, sp_core_history_length (w->core) - width);
+        if (w->scroll + n <= max_scroll) {
+            w->scroll += n;
+            return 0;
         }
+        w->scroll = max_scroll;
+        __atomic_store_n (&w->redraw, 1, __ATOMIC_RELEASE);
+        spectrogram_render_view (w, width, height);
+        return -1;
+    }
 
-        // Render left channel in top half
-        render_channel_spectrogram(w, w->data_left, data, stride, width, 0, half_height, ratio);
-        
-        // Render right channel in bottom half
-        render_channel_spectrogram(w, w->data_right, data, stride, width, half_height, height, ratio);
+    // Columns that would scroll out of view right away are not worth
+    // drawing, they only go to the history so it has no gaps
+    int n = 0;
+    for (int pending = sp_core_pending (w->core); pending > width; pending--) {
+        n += sp_core_render_column (w->core, NULL, 0, 0, height);
+    }
+
+    // Render one lane per channel from top to bottom, one column per
+    // analyzed hop. Instead of scrolling the whole image only the
+    // oldest columns are overwritten, the scrolling happens when blitting.
+    while (sp_core_render_column (w->core, data, stride, w->surf_cursor, height)) {
+        cairo_surface_mark_dirty_rectangle (w->surf, w->surf_cursor, 0, 1, height);
+        w->surf_cursor = (w->surf_cursor + 1) % width;
+        n++;
+    }
+    return n;
+}
+
+// Bring the surface up to date and invalidate what changed on screen.
+// With GTK2 that is only the strip of new columns at the right edge, the
+// rest of the view is moved left by as much. With GTK3 new columns repaint
+// the whole view: since 3.16 gdk_window_scroll copies nothing and
+// invalidates all of the window anyway.
+static void
+spectrogram_update (w_spectrogram_t *w)
+{
+    GtkAllocation a;
+    gtk_widget_get_allocation (w->drawarea, &a);
+    GdkWindow *window = gtk_widget_get_window (w->drawarea);
+    if (!w->core || a.height < 2 || !window) {
+        return;
+    }
+
+    const int timed = sp_core_stats_enabled (w->core);
+    uint64_t t0 = 0;
+    if (timed) {
+        t0 = sp_core_stats_clock ();
+        gint64 now = g_get_monotonic_time ();
+        if ((w->drawtimer || w->tick) && w->last_draw && now - w->last_draw > CONFIG_REFRESH_INTERVAL * 1500) {
+            sp_core_stats_count (w->core, SP_STAT_LATE, 1);
+        }
+        w->last_draw = now;
+    }
+
+    int full = spectrogram_render_view (w, a.width, a.height);
+    int n = spectrogram_render_columns (w, a.width, a.height);
+    if (timed) {
+        sp_core_stats_time (w->core, SP_STAT_DRAW, sp_core_stats_clock () - t0);
     }
-    cairo_surface_mark_dirty (w->surf);
 
+    if (full || n < 0 || n >= a.width) {
+        gtk_widget_queue_draw (w->drawarea);
+        return;
+    }
+#if GTK_CHECK_VERSION(3,0,0)
+    if (n > 0) {
+        gtk_widget_queue_draw (w->drawarea);
+        return;
+    }
+#else
+    if (n > 0) {
+        // A copy on the server, the strip uncovered at the right edge is
+        // invalidated by GDK
+        gdk_window_scroll (window, -n, 0);
+    }
+    if (w->show_scale && n > 0) {
+        // Gridlines run across the view and move onto themselves, the
+        // labels and the legend stay put like the statistics
+        gtk_widget_queue_draw_area (w->drawarea, 0, 0, w->overlay_left, a.height);
+        gtk_widget_queue_draw_area (w->drawarea, a.width - w->overlay_right - n, 0, w->overlay_right + n, a.height);
+    }
+#endif
+    if (w->show_stats) {
+        // The overlay stays put, repaint it along with the copy of it
+        // that was just moved to the left
+        gtk_widget_queue_draw_area (w->drawarea, 0, 0, w->stats_right, w->stats_bottom);
+    }
+}
+
+static gboolean
+spectrogram_draw (GtkWidget *widget, cairo_t *cr, gpointer user_data) {
+    w_spectrogram_t *w = user_data;
+    GtkAllocation a;
+    gtk_widget_get_allocation (widget, &a);
+    if (!w->core || a.height < 2) {
+        return FALSE;
+    }
+
+    // Only ever paints the clip GTK hands in, normally the damage left
+    // by spectrogram_update. A resize or a recolor can't wait for the
+    // next update though, and then the whole view needs painting.
+    if (spectrogram_render_view (w, a.width, a.height)) {
+        gtk_widget_queue_draw (widget);
+    }
+    if (!cairo_image_surface_get_data (w->surf)) {
+        return FALSE;
+    }
+
+    const int timed = sp_core_stats_enabled (w->core);
+    uint64_t t1 = timed ? sp_core_stats_clock () : 0;
+
+    // Oldest column (at the cursor) goes to the left edge, the newest one
+    // (right before the cursor) to the right edge
+    int split = a.width - w->surf_cursor;
     cairo_save (cr);
-    cairo_set_source_surface (cr, w->surf, 0, 0);
-    cairo_rectangle (cr, 0, 0, a.width, a.height);
+    cairo_set_source_surface (cr, w->surf, -w->surf_cursor, 0);
+    cairo_rectangle (cr, 0, 0, split, a.height);
     cairo_fill (cr);
+    if (w->surf_cursor > 0) {
+        cairo_set_source_surface (cr, w->surf, split, 0);
+        cairo_rectangle (cr, split, 0, w->surf_cursor, a.height);
+        cairo_fill (cr);
+    }
     cairo_restore (cr);
 
+    if (w->show_scale) {
+        // A new overlay has to go over all of the view at once
+        if (spectrogram_update_overlay (w, a.width, a.height)) {
+            gtk_widget_queue_draw (widget);
+        }
+        cairo_set_source_surface (cr, w->overlay, 0, 0);
+        cairo_paint (cr);
+    }
+    if (timed) {
+        sp_core_stats_time (w->core, SP_STAT_BLIT, sp_core_stats_clock () - t1);
+    }
+    if (w->show_stats) {
+        spectrogram_draw_stats (w, cr);
+    }
     return FALSE;
 }
 
@@ -863,11 +1295,144 @@ spectrogram_draw (GtkWidget *widget, cairo_t *cr, gpointer user_data) {
 gboolean
 spectrogram_expose_event (GtkWidget *widget, GdkEventExpose *event, gpointer user_data) {
     cairo_t *cr = gdk_cairo_create (gtk_widget_get_window (widget));
+    // GTK3 clips the draw signal already
+    gdk_cairo_rectangle (cr, &event->area);
+    cairo_clip (cr);
     gboolean res = spectrogram_draw (widget, cr, user_data);
     cairo_destroy (cr);
     return res;
 }
 
+#if GTK_CHECK_VERSION(3,0,0)
+// One update in the frame asked for by the timer
+static gboolean
+spectrogram_tick_cb (GtkWidget *widget, GdkFrameClock *clock, gpointer user_data)
+{
+    w_spectrogram_t *w = user_data;
+    w->tick = 0;
+    spectrogram_update (w);
+    return G_SOURCE_REMOVE;
+}
+#endif
+
+gboolean
+w_spectrogram_draw_cb (void *data) {
+    w_spectrogram_t *s = data;
+#if GTK_CHECK_VERSION(3,0,0)
+    // A tick callback keeps the frame clock running at the display rate,
+    // so it is only there until the next frame. A frame still pending
+    // from the last interval (toplevel not painted) isn't asked for again.
+    if (!s->tick) {
+        s->tick = gtk_widget_add_tick_callback (s->drawarea, spectrogram_tick_cb, s, NULL);
+    }
+#else
+    spectrogram_update (s);
+#endif
+    return TRUE;
+}
+
+// Redraws run while playing and the widget can be seen
+static void
+spectrogram_update_pacing (w_spectrogram_t *w)
+{
+    int run = w->playing && w->visible && CONFIG_REFRESH_INTERVAL > 0;
+    if (w->drawtimer) {
+        g_source_remove (w->drawtimer);
+        w->drawtimer = 0;
+    }
+#if GTK_CHECK_VERSION(3,0,0)
+    if (!run && w->tick) {
+        gtk_widget_remove_tick_callback (w->drawarea, w->tick);
+        w->tick = 0;
+    }
+#endif
+    if (run) {
+        w->last_draw = 0;
+        w->drawtimer = g_timeout_add (CONFIG_REFRESH_INTERVAL, w_spectrogram_draw_cb, w);
+    }
+}
+
+// While the widget can't be seen the analysis worker stops as well. The
+// audio keeps going into the ring buffer, and once the widget shows again
+// the worker catches up from there, skipping what the ring no longer
+// holds. After longer breaks the view is repainted from the track cache,
+// so the new columns don't end up next to ones from minutes ago.
+static void
+spectrogram_update_visible (w_spectrogram_t *w)
+{
+    int visible = w->mapped && !w->obscured && !w->iconified;
+    if (visible == w->visible) {
+        return;
+    }
+    w->visible = visible;
+    gint64 now = g_get_monotonic_time ();
+    if (!visible) {
+        w->hidden_since = now;
+    }
+    else if (w->playing && w->scroll == 0 && w->hidden_since && now - w->hidden_since > G_USEC_PER_SEC) {
+        __atomic_store_n (&w->refill, 1, __ATOMIC_RELEASE);
+    }
+    if (w->core) {
+        if (visible) {
+            sp_core_start (w->core);
+        }
+        else {
+            sp_core_stop (w->core);
+        }
+    }
+    spectrogram_update_pacing (w);
+}
+
+static gboolean
+spectrogram_window_state_event (GtkWidget *widget, GdkEventWindowState *event, gpointer user_data)
+{
+    w_spectrogram_t *w = user_data;
+    w->iconified = (event->new_window_state & (GDK_WINDOW_STATE_ICONIFIED | GDK_WINDOW_STATE_WITHDRAWN)) != 0;
+    spectrogram_update_visible (w);
+    return FALSE;
+}
+
+static gboolean
+spectrogram_visibility_notify_event (GtkWidget *widget, GdkEventVisibility *event, gpointer user_data)
+{
+    w_spectrogram_t *w = user_data;
+    w->obscured = event->state == GDK_VISIBILITY_FULLY_OBSCURED;
+    spectrogram_update_visible (w);
+    return FALSE;
+}
+
+// Unmapped on hidden notebook tabs and collapsed panes. Minimizing keeps
+// the widget mapped, that is only seen by the toplevel.
+static void
+spectrogram_map (GtkWidget *widget, gpointer user_data)
+{
+    w_spectrogram_t *w = user_data;
+    w->mapped = 1;
+    w->toplevel = gtk_widget_get_toplevel (widget);
+    if (w->toplevel != widget && !w->toplevel_handler) {
+        GdkWindow *window = gtk_widget_get_window (w->toplevel);
+        w->iconified = window && (gdk_window_get_state (window) & GDK_WINDOW_STATE_ICONIFIED);
+        w->toplevel_handler = g_signal_connect ((gpointer) w->toplevel, "window_state_event",
+                G_CALLBACK (spectrogram_window_state_event), w);
+    }
+    spectrogram_update_visible (w);
+}
+
+static void
+spectrogram_unmap (GtkWidget *widget, gpointer user_data)
+{
+    w_spectrogram_t *w = user_data;
+    w->mapped = 0;
+    // Only reported while mapped, start over with the next map
+    w->obscured = 0;
+    w->iconified = 0;
+    if (w->toplevel_handler) {
+        g_signal_handler_disconnect (w->toplevel, w->toplevel_handler);
+        w->toplevel_handler = 0;
+    }
+    spectrogram_update_visible (w);
+}
+
 
 gboolean
 spectrogram_button_press_event (GtkWidget *widget, GdkEventButton *event, gpointer user_data)
@@ -890,21 +1455,103 @@ spectrogram_button_release_event (GtkWidget *widget, GdkEventButton *event, gpoi
     return TRUE;
 }
 
-static gboolean
-spectrogram_set_refresh_interval (gpointer user_data, int interval)
+// Wheel up goes back in time by an eighth of the width, down forward again
+// until the view follows the playback
+gboolean
+spectrogram_scroll_event (GtkWidget *widget, GdkEventScroll *event, gpointer user_data)
 {
     w_spectrogram_t *w = user_data;
-    if (!w || interval <= 0) {
+    GtkAllocation a;
+    gtk_widget_get_allocation (w->drawarea, &a);
+    if (!w->core) {
         return FALSE;
     }
-    if (w->drawtimer) {
-        g_source_remove (w->drawtimer);
-        w->drawtimer = 0;
+    int step = MAX (1, a.width / 8);
+    int scroll = w->scroll;
+    if (event->direction == GDK_SCROLL_UP) {
+        scroll = MIN (scroll + step, MAX (0, sp_core_history_length (w->core) - a.width));
+    }
+    else if (event->direction == GDK_SCROLL_DOWN) {
+        scroll = MAX (0, scroll - step);
+    }
+    else {
+        return FALSE;
+    }
+    if (scroll != w->scroll) {
+        w->scroll = scroll;
+        __atomic_store_n (&w->redraw, 1, __ATOMIC_RELEASE);
+        spectrogram_update (w);
     }
-    w->drawtimer = g_timeout_add (interval, w_spectrogram_draw_cb, w);
     return TRUE;
 }
 
+static void
+on_stats_toggled (GtkCheckMenuItem *menuitem, gpointer user_data)
+{
+    w_spectrogram_t *w = user_data;
+    w->show_stats = gtk_check_menu_item_get_active (menuitem);
+    w->last_draw = 0;
+    spectrogram_update_stats (w);
+    gtk_widget_queue_draw (w->drawarea);
+}
+
+static void
+on_scale_toggled (GtkCheckMenuItem *menuitem, gpointer user_data)
+{
+    w_spectrogram_t *w = user_data;
+    w->show_scale = gtk_check_menu_item_get_active (menuitem);
+    gtk_widget_queue_draw (w->drawarea);
+}
+
+static void
+on_lane_mode_toggled (GtkCheckMenuItem *menuitem, gpointer user_data)
+{
+    w_spectrogram_t *w = user_data;
+    if (!gtk_check_menu_item_get_active (menuitem)) {
+        return;
+    }
+    for (int i = 0; i < SP_LANES_COUNT; i++) {
+        if (w->lane_items[i] == GTK_WIDGET (menuitem) && w->lane_mode != i) {
+            w->lane_mode = i;
+            spectrogram_apply_config (w);
+        }
+    }
+}
+
+// Widget parameters in the layout, e.g. "lanes=1 scale=1"
+static void
+w_spectrogram_save (ddb_gtkui_widget_t *widget, char *s, int sz)
+{
+    w_spectrogram_t *w = (w_spectrogram_t *)widget;
+    char save[100];
+    snprintf (save, sizeof (save), " lanes=%d scale=%d", w->lane_mode, w->show_scale);
+    strncat (s, save, sz - strlen (s) - 1);
+}
+
+static const char *
+w_spectrogram_load (ddb_gtkui_widget_t *widget, const char *type, const char *s)
+{
+    w_spectrogram_t *w = (w_spectrogram_t *)widget;
+    // key=value pairs up to the children in braces
+    while (*s && *s != '{') {
+        char key[64], val[64];
+        int n = 0;
+        if (sscanf (s, " %63[^= {]=%63[^ {]%n", key, val, &n) == 2 && n > 0) {
+            if (!strcmp (key, "lanes")) {
+                w->lane_mode = CLAMP (atoi (val), 0, SP_LANES_COUNT-1);
+            }
+            else if (!strcmp (key, "scale")) {
+                w->show_scale = atoi (val) != 0;
+            }
+            s += n;
+        }
+        else {
+            s++;
+        }
+    }
+    return s;
+}
+
 static int
 spectrogram_message (ddb_gtkui_widget_t *widget, uint32_t id, uintptr_t ctx, uint32_t p1, uint32_t p2)
 {
@@ -913,27 +1560,24 @@ spectrogram_message (ddb_gtkui_widget_t *widget, uint32_t id, uintptr_t ctx, uin
     switch (id) {
         case DB_EV_CONFIGCHANGED:
             on_config_changed (w, ctx);
-            spectrogram_set_refresh_interval (w, CONFIG_REFRESH_INTERVAL);
+            // picks up a new refresh interval
+            spectrogram_update_pacing (w);
             break;
         case DB_EV_SONGSTARTED:
-            spectrogram_set_refresh_interval (w, CONFIG_REFRESH_INTERVAL);
+            spectrogram_set_track (w);
+            w->playing = 1;
+            spectrogram_update_pacing (w);
+            break;
+        case DB_EV_SEEKED:
+            __atomic_store_n (&w->refill, 1, __ATOMIC_RELEASE);
             break;
         case DB_EV_PAUSED:
-            if (deadbeef->get_output ()->state () == OUTPUT_STATE_PLAYING) {
-                spectrogram_set_refresh_interval (w, CONFIG_REFRESH_INTERVAL);
-            }
-            else {
-                if (w->drawtimer) {
-                    g_source_remove (w->drawtimer);
-                    w->drawtimer = 0;
-                }
-            }
+            w->playing = deadbeef->get_output ()->state () == OUTPUT_STATE_PLAYING;
+            spectrogram_update_pacing (w);
             break;
         case DB_EV_STOP:
-            if (w->drawtimer) {
-                g_source_remove (w->drawtimer);
-                w->drawtimer = 0;
-            }
+            w->playing = 0;
+            spectrogram_update_pacing (w);
             break;
     }
     return 0;
@@ -943,83 +1587,85 @@ void
 w_spectrogram_init (ddb_gtkui_widget_t *w) {
     w_spectrogram_t *s = (w_spectrogram_t *)w;
     load_config ();
-    deadbeef->mutex_lock (s->mutex);
-    
-    // Allocate stereo sample buffers
-    s->samples_left = malloc (sizeof (double) * FFT_SIZE);
-    s->samples_right = malloc (sizeof (double) * FFT_SIZE);
-    memset (s->samples_left, 0, sizeof (double) * FFT_SIZE);
-    memset (s->samples_right, 0, sizeof (double) * FFT_SIZE);
-    
-    // Allocate stereo data buffers
-    s->data_left = malloc (sizeof (double) * FFT_SIZE);
-    s->data_right = malloc (sizeof (double) * FFT_SIZE);
-    memset (s->data_left, 0, sizeof (double) * FFT_SIZE);
-    memset (s->data_right, 0, sizeof (double) * FFT_SIZE);
-    
+
     if (s->drawtimer) {
         g_source_remove (s->drawtimer);
         s->drawtimer = 0;
     }
-    s->samplerate = 44100.0;
-    s->height = 0;
-    s->low_res_end = 0;
-    s->log_index = (int *)malloc (sizeof (int) * MAX_HEIGHT);
-    memset (s->log_index, 0, sizeof (int) * MAX_HEIGHT);
-
-    for (int i = 0; i < FFT_SIZE; i++) {
-        // Blackman-Harris window
-        s->window[i] = 0.35875 - 0.48829 * cos(2 * M_PI * i /(FFT_SIZE)) + 0.14128 * cos(4 * M_PI * i/(FFT_SIZE)) - 0.01168 * cos(6 * M_PI * i/(FFT_SIZE));;
-    }
-    create_gradient_table (s, CONFIG_GRADIENT_COLORS, CONFIG_NUM_COLORS);
-    
-    // Allocate stereo FFT input buffers
-    s->in_left = fftw_malloc (sizeof (double) * FFT_SIZE);
-    s->in_right = fftw_malloc (sizeof (double) * FFT_SIZE);
-    memset (s->in_left, 0, sizeof (double) * FFT_SIZE);
-    memset (s->in_right, 0, sizeof (double) * FFT_SIZE);
-    
-    // Allocate stereo FFT output buffers
-    s->out_complex_left = fftw_malloc (sizeof (fftw_complex) * FFT_SIZE);
-    s->out_complex_right = fftw_malloc (sizeof (fftw_complex) * FFT_SIZE);
-    
-    // Create stereo FFT plans
-    s->p_r2c_left = fftw_plan_dft_r2c_1d (FFT_SIZE, s->in_left, s->out_complex_left, FFTW_ESTIMATE);
-    s->p_r2c_right = fftw_plan_dft_r2c_1d (FFT_SIZE, s->in_right, s->out_complex_right, FFTW_ESTIMATE);
-    
-    spectrogram_set_refresh_interval (s, CONFIG_REFRESH_INTERVAL);
-    deadbeef->mutex_unlock (s->mutex);
+    if (!s->core) {
+        s->core = sp_core_new ();
+    }
+    gtk_check_menu_item_set_active (GTK_CHECK_MENU_ITEM (s->lane_items[s->lane_mode]), TRUE);
+    gtk_check_menu_item_set_active (GTK_CHECK_MENU_ITEM (s->scale_item), s->show_scale);
+    spectrogram_apply_config (s);
+    // The worker starts once the widget is mapped and visible
+    if (s->core && s->visible) {
+        sp_core_start (s->core);
+    }
+    spectrogram_set_track (s);
+
+    s->playing = deadbeef->get_output ()->state () == OUTPUT_STATE_PLAYING;
+    spectrogram_update_pacing (s);
 }
 
 ddb_gtkui_widget_t *
 w_spectrogram_create (void) {
+    static int serial;
     w_spectrogram_t *w = malloc (sizeof (w_spectrogram_t));
     memset (w, 0, sizeof (w_spectrogram_t));
+    w->serial = serial++;
 
     w->base.widget = gtk_event_box_new ();
     w->base.init = w_spectrogram_init;
     w->base.destroy  = w_spectrogram_destroy;
     w->base.message = spectrogram_message;
+    w->base.save = w_spectrogram_save;
+    w->base.load = w_spectrogram_load;
     w->drawarea = gtk_drawing_area_new ();
     w->popup = gtk_menu_new ();
     w->popup_item = gtk_menu_item_new_with_mnemonic ("Configure");
-    w->mutex = deadbeef->mutex_create ();
+    w->stats_item = gtk_check_menu_item_new_with_mnemonic ("Show _statistics");
+    w->scale_item = gtk_check_menu_item_new_with_mnemonic ("Show s_cale");
     gtk_widget_show (w->drawarea);
     gtk_container_add (GTK_CONTAINER (w->base.widget), w->drawarea);
     gtk_widget_show (w->popup);
     //gtk_container_add (GTK_CONTAINER (w->drawarea), w->popup);
     gtk_widget_show (w->popup_item);
     gtk_container_add (GTK_CONTAINER (w->popup), w->popup_item);
+    gtk_widget_show (w->stats_item);
+    gtk_container_add (GTK_CONTAINER (w->popup), w->stats_item);
+    gtk_widget_show (w->scale_item);
+    gtk_container_add (GTK_CONTAINER (w->popup), w->scale_item);
+    w->lanes_item = gtk_menu_item_new_with_mnemonic ("_Lanes");
+    GtkWidget *lanes_menu = gtk_menu_new ();
+    GSList *group = NULL;
+    for (int i = 0; i < SP_LANES_COUNT; i++) {
+        w->lane_items[i] = gtk_radio_menu_item_new_with_mnemonic (group, lane_mode_names[i]);
+        group = gtk_radio_menu_item_get_group (GTK_RADIO_MENU_ITEM (w->lane_items[i]));
+        gtk_widget_show (w->lane_items[i]);
+        gtk_container_add (GTK_CONTAINER (lanes_menu), w->lane_items[i]);
+        g_signal_connect_after ((gpointer) w->lane_items[i], "toggled", G_CALLBACK (on_lane_mode_toggled), w);
+    }
+    gtk_menu_item_set_submenu (GTK_MENU_ITEM (w->lanes_item), lanes_menu);
+    gtk_widget_show (w->lanes_item);
+    gtk_container_add (GTK_CONTAINER (w->popup), w->lanes_item);
 #if !GTK_CHECK_VERSION(3,0,0)
     g_signal_connect_after ((gpointer) w->drawarea, "expose_event", G_CALLBACK (spectrogram_expose_event), w);
 #else
     g_signal_connect_after ((gpointer) w->drawarea, "draw", G_CALLBACK (spectrogram_draw), w);
 #endif
+    gtk_widget_add_events (w->drawarea, GDK_VISIBILITY_NOTIFY_MASK);
+    g_signal_connect_after ((gpointer) w->drawarea, "map", G_CALLBACK (spectrogram_map), w);
+    g_signal_connect_after ((gpointer) w->drawarea, "unmap", G_CALLBACK (spectrogram_unmap), w);
+    g_signal_connect_after ((gpointer) w->drawarea, "visibility_notify_event", G_CALLBACK (spectrogram_visibility_notify_event), w);
     g_signal_connect_after ((gpointer) w->base.widget, "button_press_event", G_CALLBACK (spectrogram_button_press_event), w);
     g_signal_connect_after ((gpointer) w->base.widget, "button_release_event", G_CALLBACK (spectrogram_button_release_event), w);
+    gtk_widget_add_events (w->base.widget, GDK_SCROLL_MASK);
+    g_signal_connect_after ((gpointer) w->base.widget, "scroll_event", G_CALLBACK (spectrogram_scroll_event), w);
     g_signal_connect_after ((gpointer) w->popup_item, "activate", G_CALLBACK (on_button_config), w);
+    g_signal_connect_after ((gpointer) w->stats_item, "toggled", G_CALLBACK (on_stats_toggled), w);
+    g_signal_connect_after ((gpointer) w->scale_item, "toggled", G_CALLBACK (on_scale_toggled), w);
     gtkui_plugin->w_override_signals (w->base.widget, w);
-    deadbeef->vis_waveform_listen (w, spectrogram_wavedata_listener);
     return (ddb_gtkui_widget_t *)w;
 }
 
@@ -1043,6 +1689,13 @@ int
 spectrogram_start (void)
 {
     load_config ();
+
+    // FFTW wisdom survives restarts, so measured plans are only found once
+    char *cache_dir = spectrogram_cache_dir ();
+    if (cache_dir) {
+        sp_core_set_cache_dir (cache_dir);
+    }
+    g_free (cache_dir);
     return 0;
 }
 
@@ -1050,6 +1703,7 @@ int
 spectrogram_stop (void)
 {
     save_config ();
+    sp_core_set_cache_dir (NULL);
     return 0;
 }
 
@@ -1073,6 +1727,11 @@ spectrogram_disconnect (void)
 
 static const char settings_dlg[] =
     "property \"Refresh interval (ms): \"          spinbtn[10,1000,1] "      CONFSTR_SP_REFRESH_INTERVAL        " 25 ;\n"
+    "property \"FFT planning: \"                    select[3] "              CONFSTR_SP_FFT_PLANNER             " 1 Estimate Measure Patient ;\n"
+    "property \"Dump statistics every (s, 0 = off): \" spinbtn[0,3600,1] "     CONFSTR_SP_STATS_DUMP_INTERVAL     " 0 ;\n"
+    "property \"Scrollback memory (MB): \"          spinbtn[0,1024,1] "       CONFSTR_SP_HISTORY_SIZE            " 32 ;\n"
+    "property \"Max. bandwidth (Hz, 0 = full): \"   spinbtn[0,96000,1000] "   CONFSTR_SP_MAX_BANDWIDTH           " 0 ;\n"
+    "property \"Channels (e.g. 1,2,5; empty = all): \" entry "                CONFSTR_SP_CHANNELS                " \"\" ;\n"
 ;
 
 static DB_misc_t plugin = {
@@ -0,0 +1,100 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Test driver:
+        sp_test                 run all checks
+        sp_test render FILE     write the reference image
+        sp_test compare A B     compare two reference images, e.g. from the
+                                single and the double precision build
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+
+#include "sp_fft.h"
+#include "test.h"
+
+typedef struct {
+    const char *name;
+    int (*run) (void);
+} check_t;
+
+static const check_t checks[] = {
+    { "pairs", test_pairs },
+    { "lanes", test_lanes },
+    { "ring", test_ring },
+    { "decimator", test_decimator },
+    { NULL, NULL }
+};
+
+int
+test_fail (const char *check, const char *fmt, ...)
+{
+    va_list ap;
+    va_start (ap, fmt);
+    printf ("FAIL %s: ", check);
+    vprintf (fmt, ap);
+    printf ("\n");
+    va_end (ap);
+    return 1;
+}
+
+void
+test_dft (const sp_sample_t *window, const sp_sample_t *x, int n, double *re, double *im)
+{
+    for (int k = 0; k < n/2; k++) {
+        double sum_re = 0, sum_im = 0;
+        for (int i = 0; i < n; i++) {
+            double v = (double)window[i] * x[i];
+            double phi = -2 * M_PI * (double)((int64_t)k * i % n) / n;
+            sum_re += v * cos (phi);
+            sum_im += v * sin (phi);
+        }
+        re[k] = sum_re;
+        im[k] = sum_im;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+    if (argc == 3 && !strcmp (argv[1], "render")) {
+        return test_render (argv[2]) ? 1 : 0;
+    }
+    if (argc == 4 && !strcmp (argv[1], "compare")) {
+        return test_compare (argv[2], argv[3]) ? 1 : 0;
+    }
+    if (argc != 1) {
+        fprintf (stderr, "usage: %s [render FILE | compare FILE FILE]\n", argv[0]);
+        return 2;
+    }
+
+    const char *precision = sizeof (sp_sample_t) == sizeof (double) ? "double" : "float";
+    int failed = 0;
+    for (int i = 0; checks[i].name; i++) {
+        int n = checks[i].run ();
+        printf ("%-12s %-6s %s\n", checks[i].name, precision, n ? "FAILED" : "ok");
+        failed += n > 0;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Regression tests of the engine, built and run by make test once for
+    every FFT precision. Every check is a function returning the number of
+    failures, which prints what went wrong.
+*/
+
+#ifndef __SP_TEST_H
+#define __SP_TEST_H
+
+#include <stdint.h>
+
+#include "sp_fft.h"
+
+// Print a failure, returns 1 to be added up
+int
+test_fail (const char *check, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+// Plain DFT of window * x in double precision, bins 0 to n/2-1: the
+// reference every transform is checked against
+void
+test_dft (const sp_sample_t *window, const sp_sample_t *x, int n, double *re, double *im);
+
+// Reference image of a synthetic multi-tone signal rendered with
+// sp_core_render_frames, written to path as it is in memory
+int
+test_render (const char *path);
+
+// Fails if any pixel of two reference images differs by more than one
+// step of the gradient table
+int
+test_compare (const char *path_a, const char *path_b);
+
+// Packed pair FFT against separate transforms, test_pairs.c
+int
+test_pairs (void);
+
+// M/S and correlation lanes against reference values, test_lanes.c
+int
+test_lanes (void);
+
+// Ring buffer lap detection, test_ring.c
+int
+test_ring (void);
+
+// Decimation factor and filter for Max. bandwidth, test_decimator.c
+int
+test_decimator (void);
+
+#endif // __SP_TEST_H
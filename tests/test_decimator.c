@@ -0,0 +1,99 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Decimation for Max. bandwidth: the factor must keep the whole requested
+    band, and nothing above the output's Nyquist frequency may fold back
+    into it while tones well inside the band pass unchanged.
+*/
+
+#include <stdio.h>
+#include <math.h>
+
+#include "sp_decimator.h"
+#include "test.h"
+
+static int
+check_factor (int samplerate, int bandwidth, int expect)
+{
+    int factor = sp_decimator_factor (samplerate, bandwidth);
+    if (factor != expect) {
+        return test_fail ("decimator", "factor %d for %d Hz at %d Hz bandwidth, expected %d",
+                factor, samplerate, bandwidth, expect);
+    }
+    return 0;
+}
+
+// Level in dB of the output for a full scale tone of hz at samplerate,
+// once the filter has settled
+static double
+tone_level (sp_decimator_t *d, int samplerate, double hz)
+{
+    static const int map[1] = { 0 };
+    float in[SP_DECIMATOR_CHUNK], out[SP_DECIMATOR_CHUNK + 1];
+    double sum = 0;
+    int count = 0;
+    for (int block = 0; block < 16; block++) {
+        for (int i = 0; i < SP_DECIMATOR_CHUNK; i++) {
+            int64_t frame = (int64_t)block * SP_DECIMATOR_CHUNK + i;
+            in[i] = (float)sin (2 * M_PI * hz * frame / samplerate);
+        }
+        int n = sp_decimator_run (d, in, SP_DECIMATOR_CHUNK, 1, map, 1, out);
+        // the first blocks fill the delay line
+        for (int i = 0; block >= 4 && i < n; i++) {
+            sum += (double)out[i] * out[i];
+            count++;
+        }
+    }
+    // a full scale sine has a mean square of 1/2
+    return 10 * log10 (fmax (2 * sum / count, 1e-30));
+}
+
+int
+test_decimator (void)
+{
+    int failed = 0;
+    failed += check_factor (44100, 20000, 1);
+    failed += check_factor (48000, 20000, 1);
+    failed += check_factor (96000, 20000, 2);
+    failed += check_factor (192000, 20000, 4);
+    failed += check_factor (192000, 24000, 4);
+    failed += check_factor (88200, 24000, 1);
+    failed += check_factor (384000, 4000, SP_DECIMATOR_MAX_FACTOR);
+    failed += check_factor (96000, 0, 1);
+
+    // 96 kHz by 2: the output ends at 24 kHz
+    static sp_decimator_t d;
+    sp_decimator_setup (&d, 2);
+    const struct { double hz, min_db, max_db; } tones[] = {
+        { 1000, -0.1, 0.1 },
+        { 16000, -0.1, 0.1 },
+        { 24000, -200, -75 },
+        { 25000, -200, -75 },   // would alias to 23 kHz
+        { 30000, -200, -75 },
+    };
+    for (int i = 0; i < 5; i++) {
+        double db = tone_level (&d, 96000, tones[i].hz);
+        if (db < tones[i].min_db || db > tones[i].max_db) {
+            failed += test_fail ("decimator", "%g Hz at 96 kHz comes out at %.2f dB", tones[i].hz, db);
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,183 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Derived lanes of the first pair: mid and side must match (L+R)/2 and
+    (L-R)/2 transformed on their own, and the correlation lane must follow
+    its definition, 30 dB below full scale per step of 1 down from +1 and
+    capped at the quieter channel. Tones in phase, in quadrature and in
+    opposite phase pin down +1, 0 and -1.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sp_analysis.h"
+#include "sp_level.h"
+#include "test.h"
+
+#define LANES_SIZE 1024
+
+// bins of the test tones
+#define LANES_IN_PHASE 30
+#define LANES_QUADRATURE 100
+#define LANES_OPPOSITE 250
+#define LANES_RIGHT_ONLY 400
+
+static double
+test_tone (double bin, double db, double phase, int i)
+{
+    return pow (10, db / 20) * sin (2 * M_PI * bin * i / LANES_SIZE + phase);
+}
+
+static double
+power_db (double p)
+{
+    return 10 * log10 (fmax (p, 1e-30));
+}
+
+// Expected correlation lane level from the spectra of both channels
+static double
+reference_correlation (double l_re, double l_im, double r_re, double r_im, double pl, double pr)
+{
+    if (pl <= 0 || pr <= 0) {
+        return 0;
+    }
+    const double rho = (l_re * r_re + l_im * r_im) / sqrt ((l_re*l_re + l_im*l_im) * (r_re*r_re + r_im*r_im));
+    const double c = pow (10, SP_LEVEL_FULL_SCALE / 10.0) * pow (10, -30.0 / 10 * (1 - rho));
+    return fmin (c, fmin (pl, pr));
+}
+
+static int
+check_mid_side (sp_analysis_t *a, const double *l_re, const double *l_im,
+        const double *r_re, const double *r_im, double peak, double eps)
+{
+    const int n = LANES_SIZE;
+    sp_sample_t power[LANES_SIZE];
+    sp_analysis_run (a, 0, 2, SP_LANES_MS, power);
+    for (int k = 0; k < n/2; k++) {
+        const double m_re = (l_re[k] + r_re[k]) / 2, m_im = (l_im[k] + r_im[k]) / 2;
+        const double s_re = (l_re[k] - r_re[k]) / 2, s_im = (l_im[k] - r_im[k]) / 2;
+        const double mid = a->power_scale * (m_re*m_re + m_im*m_im);
+        const double side = a->power_scale * (s_re*s_re + s_im*s_im);
+        if (fabs (power[k] - mid) > eps * peak) {
+            return test_fail ("lanes", "mid bin %d: %g, expected %g", k, (double)power[k], mid);
+        }
+        if (fabs (power[n/2 + k] - side) > eps * peak) {
+            return test_fail ("lanes", "side bin %d: %g, expected %g", k, (double)power[n/2 + k], side);
+        }
+    }
+    return 0;
+}
+
+static int
+check_correlation (sp_analysis_t *a, const double *l_re, const double *l_im,
+        const double *r_re, const double *r_im, double peak, double eps)
+{
+    const int n = LANES_SIZE;
+    const double full_scale_db = SP_LEVEL_FULL_SCALE;
+    sp_sample_t power[3 * LANES_SIZE / 2];
+    if (sp_analysis_lanes_out (2, SP_LANES_LR_CORRELATION) != 3) {
+        return test_fail ("lanes", "no correlation lane for a stereo pair");
+    }
+    sp_analysis_run (a, 0, 2, SP_LANES_LR_CORRELATION, power);
+    const sp_sample_t *corr = power + n;
+
+    for (int k = 0; k < n/2; k++) {
+        const double pl = a->power_scale * (l_re[k]*l_re[k] + l_im[k]*l_im[k]);
+        const double pr = a->power_scale * (r_re[k]*r_re[k] + r_im[k]*r_im[k]);
+        if (fabs (power[k] - pl) > eps * peak || fabs (power[n/2 + k] - pr) > eps * peak) {
+            return test_fail ("lanes", "left/right bin %d: %g %g, expected %g %g",
+                    k, (double)power[k], (double)power[n/2 + k], pl, pr);
+        }
+        // the phase of bins far down in the leakage is only noise
+        if (fmin (pl, pr) < 1e-4 * peak) {
+            continue;
+        }
+        const double c = reference_correlation (l_re[k], l_im[k], r_re[k], r_im[k], pl, pr);
+        if (fabs (power_db (corr[k]) - power_db (c)) > 0.01) {
+            return test_fail ("lanes", "correlation bin %d: %.2f dB, expected %.2f dB",
+                    k, power_db (corr[k]), power_db (c));
+        }
+    }
+
+    // fixed points: in phase is the quieter channel, quadrature 30 dB and
+    // opposite phase 60 dB below full scale
+    const struct { int bin; double db; } fixed[] = {
+        { LANES_IN_PHASE, power_db (fmin (power[LANES_IN_PHASE], power[n/2 + LANES_IN_PHASE])) },
+        { LANES_QUADRATURE, full_scale_db - 30 },
+        { LANES_OPPOSITE, full_scale_db - 60 },
+    };
+    for (int i = 0; i < 3; i++) {
+        const double db = power_db (corr[fixed[i].bin]);
+        if (fabs (db - fixed[i].db) > 0.1) {
+            return test_fail ("lanes", "correlation at bin %d: %.2f dB, expected %.2f dB",
+                    fixed[i].bin, db, fixed[i].db);
+        }
+    }
+    // a tone in one channel alone leaves only the leakage of the other
+    if (power_db (corr[LANES_RIGHT_ONLY]) > power_db (power[LANES_RIGHT_ONLY]) + 0.01) {
+        return test_fail ("lanes", "correlation above the silent channel at bin %d", LANES_RIGHT_ONLY);
+    }
+    return 0;
+}
+
+int
+test_lanes (void)
+{
+    const int n = LANES_SIZE;
+    // single precision carries about 7 digits through the transform
+    const double eps = sizeof (sp_sample_t) == sizeof (float) ? 1e-5 : 1e-10;
+    sp_analysis_t *a = sp_analysis_new (n, 1, SP_WINDOW_BLACKMAN_HARRIS, FFTW_ESTIMATE);
+    double *spectra = malloc (sizeof (double) * 4 * (n/2));
+    if (!a || !spectra || !sp_analysis_reserve (a, 2)) {
+        sp_analysis_free (a);
+        free (spectra);
+        return test_fail ("lanes", "no analysis setup");
+    }
+    double *l_re = spectra, *l_im = l_re + n/2;
+    double *r_re = l_im + n/2, *r_im = r_re + n/2;
+
+    sp_sample_t *left = a->samples, *right = a->samples + n;
+    for (int i = 0; i < n; i++) {
+        left[i] = test_tone (LANES_IN_PHASE, -12, 0.2, i)
+            + test_tone (LANES_QUADRATURE, -6, 0.3, i)
+            + test_tone (LANES_OPPOSITE, -10, 0.4, i);
+        right[i] = test_tone (LANES_IN_PHASE, -12, 0.2, i)
+            + test_tone (LANES_QUADRATURE, -6, 0.3 + M_PI/2, i)
+            + test_tone (LANES_OPPOSITE, -10, 0.4 + M_PI, i)
+            + test_tone (LANES_RIGHT_ONLY, -20, 0, i);
+    }
+    test_dft (a->window, left, n, l_re, l_im);
+    test_dft (a->window, right, n, r_re, r_im);
+    double peak = 0;
+    for (int k = 0; k < n/2; k++) {
+        peak = fmax (peak, a->power_scale * (l_re[k]*l_re[k] + l_im[k]*l_im[k]));
+        peak = fmax (peak, a->power_scale * (r_re[k]*r_re[k] + r_im[k]*r_im[k]));
+    }
+
+    int failed = check_mid_side (a, l_re, l_im, r_re, r_im, peak, eps);
+    failed += check_correlation (a, l_re, l_im, r_re, r_im, peak, eps);
+
+    sp_analysis_free (a);
+    free (spectra);
+    return failed;
+}
@@ -0,0 +1,124 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Packed pair FFT: two lanes transformed as one complex FFT and separated
+    again by symmetry must give the same power spectra as transforming each
+    lane on its own, here a plain DFT in double precision. A silent lane
+    next to a loud one must stay silent.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sp_analysis.h"
+#include "test.h"
+
+#define PAIRS_SIZE 1024
+#define PAIRS_LANES 3
+
+// power_scale * |DFT (window * x)|^2, size/2 bins
+static void
+reference_power (const sp_analysis_t *a, const sp_sample_t *x, double *out)
+{
+    const int n = a->size;
+    double re[PAIRS_SIZE/2], im[PAIRS_SIZE/2];
+    test_dft (a->window, x, n, re, im);
+    for (int k = 0; k < n/2; k++) {
+        out[k] = a->power_scale * (re[k] * re[k] + im[k] * im[k]);
+    }
+}
+
+static double
+test_tone (double bin, double db, int i)
+{
+    return pow (10, db / 20) * sin (2 * M_PI * bin * i / PAIRS_SIZE + 0.3);
+}
+
+static int
+check_lanes (sp_analysis_t *a, const char *what)
+{
+    const int n = PAIRS_SIZE;
+    // single precision carries about 7 digits through the transform
+    const double eps = sizeof (sp_sample_t) == sizeof (float) ? 1e-5 : 1e-10;
+    sp_sample_t *power = malloc (sizeof (sp_sample_t) * PAIRS_LANES * (n/2));
+    double *ref = malloc (sizeof (double) * PAIRS_LANES * (n/2));
+    if (!power || !ref) {
+        free (power);
+        free (ref);
+        return test_fail ("pairs", "out of memory");
+    }
+    for (int pair = 0; pair < sp_analysis_pairs (PAIRS_LANES); pair++) {
+        sp_analysis_run (a, pair, PAIRS_LANES, SP_LANES_LR, power);
+    }
+    double peak = 0;
+    for (int lane = 0; lane < PAIRS_LANES; lane++) {
+        reference_power (a, a->samples + (size_t)lane * n, ref + (size_t)lane * (n/2));
+    }
+    for (int i = 0; i < PAIRS_LANES * (n/2); i++) {
+        peak = fmax (peak, ref[i]);
+    }
+    int failed = 0;
+    for (int lane = 0; lane < PAIRS_LANES && !failed; lane++) {
+        for (int k = 0; k < n/2; k++) {
+            const size_t i = (size_t)lane * (n/2) + k;
+            if (fabs (power[i] - ref[i]) > eps * peak) {
+                failed = test_fail ("pairs", "%s: lane %d bin %d: %g, separate transform %g (peak %g)",
+                        what, lane, k, (double)power[i], ref[i], peak);
+                break;
+            }
+        }
+    }
+    free (power);
+    free (ref);
+    return failed;
+}
+
+int
+test_pairs (void)
+{
+    const int n = PAIRS_SIZE;
+    sp_analysis_t *a = sp_analysis_new (n, 1, SP_WINDOW_BLACKMAN_HARRIS, FFTW_ESTIMATE);
+    if (!a || !sp_analysis_reserve (a, PAIRS_LANES)) {
+        sp_analysis_free (a);
+        return test_fail ("pairs", "no analysis setup");
+    }
+    int failed = 0;
+
+    // Different tones in every lane, the last one transformed alone
+    for (int i = 0; i < n; i++) {
+        a->samples[i] = test_tone (100.3, -6, i) + test_tone (37, -40, i);
+        a->samples[n + i] = test_tone (211.7, -20, i);
+        a->samples[2*n + i] = test_tone (5.5, -3, i) + test_tone (400, -60, i);
+    }
+    failed += check_lanes (a, "tones");
+
+    // Nothing of a full scale left lane may leak into a silent right one
+    for (int i = 0; i < n; i++) {
+        a->samples[i] = test_tone (100.3, 0, i) + test_tone (300, 0, i);
+        a->samples[n + i] = 0;
+        a->samples[2*n + i] = 0;
+    }
+    failed += check_lanes (a, "silent lane");
+
+    sp_analysis_free (a);
+    return failed;
+}
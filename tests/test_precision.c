@@ -0,0 +1,235 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Reference rendering for comparing builds: a stereo signal of tones at
+    different levels, a sweep and a noise floor, rendered column by column
+    with sp_core_render_frames in two setups stacked on top of each other,
+    log scale with multires above and linear scale below. The single and
+    the double precision build must agree to one gradient step.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "sp_core.h"
+#include "test.h"
+
+#define REF_WIDTH 256
+#define REF_HEIGHT 512
+#define REF_SAMPLERATE 44100
+#define REF_HOP 512
+
+// the default palette of the widget, loudest first
+static const sp_color_t ref_colors[] = {
+    { 65535, 0, 0 },
+    { 65535, 32896, 0 },
+    { 65535, 65535, 0 },
+    { 32896, 65535, 30840 },
+    { 0, 38036, 41120 },
+    { 0, 8224, 25700 },
+    { 0, 0, 0 },
+};
+#define REF_NUM_COLORS (int)(sizeof (ref_colors) / sizeof (ref_colors[0]))
+
+static double
+tone (double hz, double db, int64_t frame)
+{
+    return pow (10, db / 20) * sin (2 * M_PI * hz * frame / REF_SAMPLERATE);
+}
+
+// Exponential sweep from 200 Hz to 18 kHz over the width of the image
+static double
+sweep (double db, int64_t frame)
+{
+    const double T = (double)REF_WIDTH * REF_HOP / REF_SAMPLERATE;
+    const double t = (double)frame / REF_SAMPLERATE;
+    const double k = 18000 / 200.;
+    return pow (10, db / 20) * sin (2 * M_PI * 200 * T / log (k) * (pow (k, t / T) - 1));
+}
+
+// n interleaved stereo frames from frame on, the same in every build
+static void
+ref_signal (float *out, int64_t frame, int n)
+{
+    for (int i = 0; i < n; i++, frame++) {
+        // noise by frame number, so any window of it is reproducible
+        uint32_t x = (uint32_t)frame * 2654435761u;
+        x ^= x >> 15;
+        x *= 2246822519u;
+        x ^= x >> 13;
+        double noise = pow (10, -60 / 20.) * ((x & 0xffff) / 32768. - 1);
+        out[2*i] = tone (100, -6, frame) + tone (1000, -12, frame) + tone (5000, -30, frame)
+            + tone (15000, -50, frame) + noise;
+        out[2*i+1] = tone (440, -10, frame) + tone (3000, -20, frame) + sweep (-20, frame) + noise / 2;
+    }
+}
+
+static sp_core_t *
+ref_core (int log_scale, int multires)
+{
+    sp_core_t *core = sp_core_new ();
+    if (!core) {
+        return NULL;
+    }
+    sp_config_t conf = {
+        .log_scale = log_scale,
+        .db_range = 70,
+        .refresh_interval = 25,
+        .hop_size = REF_HOP,
+        .fft_size = 8192,
+        .window = SP_WINDOW_BLACKMAN_HARRIS,
+        .planner = SP_PLANNER_ESTIMATE,
+        .multires = multires,
+    };
+    sp_core_set_gradient (core, ref_colors, REF_NUM_COLORS);
+    sp_core_set_config (core, &conf);
+    while (sp_core_planning (core) || !sp_core_window_size (core)) {
+        usleep (1000);
+    }
+    return core;
+}
+
+// Index of the first gradient entry of color, -1 if there is none
+static int
+gradient_index (sp_core_t *core, uint32_t color)
+{
+    for (int i = 0; i < GRADIENT_TABLE_SIZE; i++) {
+        if (sp_core_gradient_color (core, i) == color) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int
+test_render (const char *path)
+{
+    uint32_t *image = calloc ((size_t)REF_WIDTH * REF_HEIGHT, sizeof (uint32_t));
+    if (!image) {
+        return test_fail ("render", "out of memory");
+    }
+    const int stride = REF_WIDTH * sizeof (uint32_t);
+    const int height = REF_HEIGHT / 2;
+    int failed = 0;
+    for (int setup = 0; setup < 2; setup++) {
+        sp_core_t *core = ref_core (setup == 0, setup == 0);
+        if (!core) {
+            free (image);
+            return test_fail ("render", "no core");
+        }
+        const int window = sp_core_window_size (core);
+        float *frames = malloc (sizeof (float) * 2 * window);
+        uint8_t *data = (uint8_t *)(image + (size_t)setup * height * REF_WIDTH);
+        for (int x = 0; frames && x < REF_WIDTH; x++) {
+            ref_signal (frames, (int64_t)x * REF_HOP, window);
+            if (!sp_core_render_frames (core, frames, 2, REF_SAMPLERATE, data, stride, x, height)) {
+                failed += test_fail ("render", "column %d not rendered", x);
+                break;
+            }
+        }
+        // Not comparing two blank images: the 1 kHz tone at -12 dB has to
+        // show in the loudest part of the gradient
+        int y = sp_core_freq_row (core, 0, 1000);
+        uint32_t color = y < 0 ? 0 : image[((size_t)setup * height + y) * REF_WIDTH + REF_WIDTH / 2] & 0xffffff;
+        int index = gradient_index (core, color);
+        if (y < 0 || index < 0 || index > GRADIENT_TABLE_SIZE / 2) {
+            failed += test_fail ("render", "setup %d: no 1 kHz tone at row %d (gradient index %d)", setup, y, index);
+        }
+        free (frames);
+        sp_core_free (core);
+    }
+
+    FILE *fp = fopen (path, "wb");
+    if (!fp || fwrite (image, sizeof (uint32_t), (size_t)REF_WIDTH * REF_HEIGHT, fp) != (size_t)REF_WIDTH * REF_HEIGHT) {
+        failed += test_fail ("render", "can't write %s", path);
+    }
+    if (fp) {
+        fclose (fp);
+    }
+    free (image);
+    return failed;
+}
+
+static uint32_t *
+read_image (const char *path)
+{
+    uint32_t *image = malloc ((size_t)REF_WIDTH * REF_HEIGHT * sizeof (uint32_t));
+    FILE *fp = fopen (path, "rb");
+    if (!image || !fp || fread (image, sizeof (uint32_t), (size_t)REF_WIDTH * REF_HEIGHT, fp) != (size_t)REF_WIDTH * REF_HEIGHT) {
+        free (image);
+        image = NULL;
+    }
+    if (fp) {
+        fclose (fp);
+    }
+    return image;
+}
+
+int
+test_compare (const char *path_a, const char *path_b)
+{
+    uint32_t *a = read_image (path_a);
+    uint32_t *b = read_image (path_b);
+    sp_core_t *core = sp_core_new ();
+    int failed = 0;
+    if (!a || !b || !core) {
+        failed = test_fail ("compare", "can't read %s and %s", path_a, path_b);
+        goto out;
+    }
+    sp_core_set_gradient (core, ref_colors, REF_NUM_COLORS);
+
+    // Colors can repeat in the table, so one step apart means next to
+    // each other somewhere in it
+    int one_step = 0;
+    for (int y = 0; y < REF_HEIGHT; y++) {
+        for (int x = 0; x < REF_WIDTH; x++) {
+            uint32_t ca = a[y * REF_WIDTH + x] & 0xffffff;
+            uint32_t cb = b[y * REF_WIDTH + x] & 0xffffff;
+            if (ca == cb) {
+                continue;
+            }
+            int adjacent = 0;
+            for (int i = 0; i < GRADIENT_TABLE_SIZE - 1 && !adjacent; i++) {
+                uint32_t c0 = sp_core_gradient_color (core, i);
+                uint32_t c1 = sp_core_gradient_color (core, i + 1);
+                adjacent = (c0 == ca && c1 == cb) || (c0 == cb && c1 == ca);
+            }
+            if (adjacent) {
+                one_step++;
+            }
+            else if (failed++ < 10) {
+                test_fail ("compare", "pixel %d,%d: %06x vs %06x (gradient index %d vs %d)", x, y,
+                        ca, cb, gradient_index (core, ca), gradient_index (core, cb));
+            }
+        }
+    }
+    printf ("%-12s %d pixels one gradient step apart, %d more\n", "compare", one_step, failed);
+out:
+    if (core) {
+        sp_core_free (core);
+    }
+    free (a);
+    free (b);
+    return failed;
+}
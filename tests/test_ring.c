@@ -0,0 +1,118 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Ring buffer reads: a window still in the ring reads back what was
+    written and succeeds, one the producer has overwritten or announced to
+    overwrite next fails, and frames before the start of the stream read
+    as silence.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sp_ringbuf.h"
+#include "test.h"
+
+#define RING_SIZE 1024
+#define RING_FRAMES 3000
+
+// frame i of channel 0 is i, of channel 1 -i
+static void
+ring_write (sp_ringbuf_t *rb, uint64_t from, int nframes)
+{
+    float data[2 * RING_FRAMES];
+    for (int i = 0; i < nframes; i++) {
+        data[2*i] = (float)(from + i);
+        data[2*i + 1] = -(float)(from + i);
+    }
+    sp_ringbuf_write (rb, data, nframes, 2, NULL, 2);
+}
+
+// Read n frames before end and compare them with what was written
+static int
+ring_check (const sp_ringbuf_t *rb, uint64_t end, int n, int expect_ok, const char *what)
+{
+    sp_sample_t out[RING_SIZE];
+    for (int ch = 0; ch < 2; ch++) {
+        int ok = sp_ringbuf_read (rb, ch, end, n, out);
+        if (ok != expect_ok) {
+            return test_fail ("ring", "%s: read of %d frames before %llu returned %d",
+                    what, n, (unsigned long long)end, ok);
+        }
+        if (!ok) {
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            int64_t frame = (int64_t)end - n + i;
+            sp_sample_t expect = frame < 0 ? 0 : (ch ? -(sp_sample_t)frame : (sp_sample_t)frame);
+            if (out[i] != expect) {
+                return test_fail ("ring", "%s: channel %d frame %lld is %g, expected %g",
+                        what, ch, (long long)frame, (double)out[i], (double)expect);
+            }
+        }
+    }
+    return 0;
+}
+
+int
+test_ring (void)
+{
+    sp_ringbuf_t rb;
+    if (sp_ringbuf_init (&rb, 2, RING_SIZE - 24) || rb.size != RING_SIZE) {
+        sp_ringbuf_free (&rb);
+        return test_fail ("ring", "no ring of %d frames", RING_SIZE);
+    }
+    int failed = 0;
+
+    // start of the stream
+    ring_write (&rb, 0, 10);
+    failed += ring_check (&rb, 10, 32, 1, "before the start");
+
+    // several laps in blocks that do not divide the size
+    for (uint64_t pos = 10; pos < RING_FRAMES; pos += 100) {
+        ring_write (&rb, pos, RING_FRAMES - pos < 100 ? (int)(RING_FRAMES - pos) : 100);
+    }
+    const uint64_t end = sp_ringbuf_write_pos (&rb);
+    if (end != RING_FRAMES) {
+        failed += test_fail ("ring", "write position %llu after %d frames",
+                (unsigned long long)end, RING_FRAMES);
+    }
+    failed += ring_check (&rb, end, RING_SIZE, 1, "whole ring");
+    failed += ring_check (&rb, end - 100, 300, 1, "across the wrap");
+    failed += ring_check (&rb, end - RING_SIZE + 16, 16, 1, "oldest frames");
+    failed += ring_check (&rb, end - RING_SIZE + 15, 16, 0, "one frame lapped");
+    failed += ring_check (&rb, 200, 100, 0, "several laps ago");
+
+    // a producer in the middle of a write has announced the frames it is
+    // about to overwrite, those must not pass as valid
+    rb.write_end = end + 64;
+    failed += ring_check (&rb, end - RING_SIZE + 64, 16, 0, "during a write");
+    failed += ring_check (&rb, end - RING_SIZE + 80, 16, 1, "behind a write");
+    rb.write_end = end;
+
+    // a single write longer than the ring keeps its last frames
+    ring_write (&rb, end, RING_FRAMES);
+    failed += ring_check (&rb, end + RING_FRAMES, RING_SIZE, 1, "long write");
+    failed += ring_check (&rb, end + RING_FRAMES - RING_SIZE, 16, 0, "long write lapped");
+
+    sp_ringbuf_free (&rb);
+    return failed;
+}
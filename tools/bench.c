@@ -0,0 +1,577 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Headless benchmark of the plugin pipeline: audio blocks shaped like
+    the ones DeaDBeeF hands to visualization listeners go through the
+    listener, the FFT analysis and the column renderer into an offscreen
+    cairo image surface, which is then blitted like in the widget's draw
+    handler. Reports per stage timings and overall throughput.
+
+    Configuration is read through a stub DB_functions_t with the same keys
+    and defaults as the plugin, values can be overridden with -o key=value.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <cairo.h>
+
+#include <deadbeef/deadbeef.h>
+
+#include "sp_core.h"
+#include "wav.h"
+
+#define MAX_SIZES 16
+#define MAX_OVERRIDES 32
+#define MAX_SCENARIOS 16
+// draw ticks at the start of every run that are not counted
+#define WARMUP_TICKS 10
+
+enum {
+    SOURCE_SINE,
+    SOURCE_NOISE,
+    SOURCE_SWEEP,
+    SOURCE_WAV,
+};
+
+static const char *source_names[] = { "sine", "noise", "sweep", "wav" };
+
+typedef struct {
+    int source;
+    int channels;
+    int samplerate;
+    const char *path;
+} scenario_t;
+
+typedef struct {
+    int width;
+    int height;
+} bench_size_t;
+
+typedef struct {
+    const char *name;
+    double *samples;
+    int count;
+    int capacity;
+} stage_t;
+
+enum {
+    STAGE_INGEST,
+    STAGE_ANALYZE,
+    STAGE_RENDER,
+    STAGE_BLIT,
+    STAGE_COUNT
+};
+
+// Stub DeaDBeeF API, only what the pipeline touches
+static DB_functions_t stub_api;
+static DB_functions_t *deadbeef = &stub_api;
+
+static struct {
+    const char *key;
+    int value;
+} overrides[MAX_OVERRIDES];
+static int num_overrides;
+
+static void *listener_ctx;
+static void (*listener_cb)(void *ctx, const ddb_audio_data_t *data);
+
+static int
+stub_conf_get_int (const char *key, int def)
+{
+    for (int i = num_overrides - 1; i >= 0; i--) {
+        if (!strcmp (overrides[i].key, key)) {
+            return overrides[i].value;
+        }
+    }
+    return def;
+}
+
+static void
+stub_vis_waveform_listen (void *ctx, void (*callback)(void *ctx, const ddb_audio_data_t *data))
+{
+    listener_ctx = ctx;
+    listener_cb = callback;
+}
+
+static void
+stub_vis_waveform_unlisten (void *ctx)
+{
+    listener_ctx = NULL;
+    listener_cb = NULL;
+}
+
+static double
+now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+stage_add (stage_t *st, double t)
+{
+    if (st->count == st->capacity) {
+        st->capacity = st->capacity ? st->capacity * 2 : 1024;
+        st->samples = realloc (st->samples, sizeof (double) * st->capacity);
+        if (!st->samples) {
+            fprintf (stderr, "out of memory\n");
+            exit (1);
+        }
+    }
+    st->samples[st->count++] = t;
+}
+
+static int
+cmp_double (const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double
+percentile (const stage_t *st, double p)
+{
+    if (!st->count) {
+        return 0;
+    }
+    int i = (int)ceil (p / 100.0 * st->count) - 1;
+    return st->samples[i < 0 ? 0 : i];
+}
+
+// Same as the widget: everything comes from the config with the plugin's
+// defaults
+static void
+bench_apply_config (sp_core_t *core)
+{
+    static const sp_color_t colors[SP_MAX_COLORS] = {
+        { 65535, 0, 0 },
+        { 65535, 32896, 0 },
+        { 65535, 65535, 0 },
+        { 32896, 65535, 30840 },
+        { 0, 38036, 41120 },
+        { 0, 8224, 25700 },
+        { 0, 0, 0 },
+    };
+    sp_core_set_gradient (core, colors, SP_MAX_COLORS);
+
+    sp_config_t conf = {
+        .log_scale = deadbeef->conf_get_int ("spectrogram.log_scale", 1),
+        .db_range = deadbeef->conf_get_int ("spectrogram.db_range", 70),
+        .refresh_interval = deadbeef->conf_get_int ("spectrogram.refresh_interval", 25),
+        .hop_size = deadbeef->conf_get_int ("spectrogram.hop_size", 1024),
+        .fft_size = deadbeef->conf_get_int ("spectrogram.fft_size", SP_DEFAULT_FFT_SIZE),
+        .window = deadbeef->conf_get_int ("spectrogram.window", SP_WINDOW_BLACKMAN_HARRIS),
+        .planner = deadbeef->conf_get_int ("spectrogram.fft_planner", SP_PLANNER_MEASURE),
+        .history_size = deadbeef->conf_get_int ("spectrogram.history_size", 32),
+        .multires = deadbeef->conf_get_int ("spectrogram.multires", 0),
+        .max_bandwidth = deadbeef->conf_get_int ("spectrogram.max_bandwidth", 0),
+    };
+    sp_core_set_config (core, &conf);
+}
+
+typedef struct {
+    sp_core_t *core;
+    stage_t *stages;
+    int counting;
+} bench_widget_t;
+
+static void
+bench_listener (void *ctx, const ddb_audio_data_t *data)
+{
+    bench_widget_t *w = ctx;
+    sp_core_ingest (w->core, data->data, data->nframes, data->fmt->channels, data->fmt->samplerate);
+}
+
+// Mirrors spectrogram_draw: render pending columns at the ring cursor,
+// then blit the ring in two parts
+static int
+bench_draw (bench_widget_t *w, cairo_surface_t *surf, int *cursor, cairo_t *cr, int width, int height)
+{
+    int columns = 0;
+    double t0 = now ();
+
+    cairo_surface_flush (surf);
+    unsigned char *data = cairo_image_surface_get_data (surf);
+    int stride = cairo_image_surface_get_stride (surf);
+    for (int pending = sp_core_pending (w->core); pending > width; pending--) {
+        sp_core_render_column (w->core, NULL, 0, 0, height);
+    }
+    while (sp_core_render_column (w->core, data, stride, *cursor, height)) {
+        cairo_surface_mark_dirty_rectangle (surf, *cursor, 0, 1, height);
+        *cursor = (*cursor + 1) % width;
+        columns++;
+    }
+    double t1 = now ();
+
+    int split = width - *cursor;
+    cairo_save (cr);
+    cairo_set_source_surface (cr, surf, -*cursor, 0);
+    cairo_rectangle (cr, 0, 0, split, height);
+    cairo_fill (cr);
+    if (*cursor > 0) {
+        cairo_set_source_surface (cr, surf, split, 0);
+        cairo_rectangle (cr, split, 0, *cursor, height);
+        cairo_fill (cr);
+    }
+    cairo_restore (cr);
+    cairo_surface_flush (cairo_get_target (cr));
+    double t2 = now ();
+
+    if (w->counting) {
+        stage_add (&w->stages[STAGE_RENDER], t1 - t0);
+        stage_add (&w->stages[STAGE_BLIT], t2 - t1);
+    }
+    return columns;
+}
+
+static uint32_t rng_state = 0x9e3779b9;
+
+static float
+noise (void)
+{
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (float)rng_state / 4294967296.f * 2.f - 1.f;
+}
+
+// Synthesize nframes interleaved frames starting at frame pos
+static void
+synthesize (const scenario_t *sc, float *out, int nframes, int64_t pos, double duration)
+{
+    const double sr = sc->samplerate;
+    for (int i = 0; i < nframes; i++) {
+        double t = (pos + i) / sr;
+        for (int c = 0; c < sc->channels; c++) {
+            float v;
+            switch (sc->source) {
+            case SOURCE_NOISE:
+                v = 0.3f * noise ();
+                break;
+            case SOURCE_SWEEP: {
+                // exponential sweep 20 Hz to nyquist over the whole run,
+                // phase shifted per channel
+                double f0 = 20.0;
+                double k = log ((sr / 2) / f0) / duration;
+                v = 0.5f * (float)sin (2 * M_PI * f0 * (exp (k * t) - 1) / k + c);
+                break;
+            }
+            case SOURCE_SINE:
+            default:
+                // a different pair of tones on every channel
+                v = 0.4f * (float)sin (2 * M_PI * (440.0 * (c + 1)) * t)
+                    + 0.1f * (float)sin (2 * M_PI * (5000.0 + 1000.0 * c) * t);
+                break;
+            }
+            out[i * sc->channels + c] = v;
+        }
+    }
+}
+
+static void
+print_stage (const stage_t *st)
+{
+    double sum = 0;
+    for (int i = 0; i < st->count; i++) {
+        sum += st->samples[i];
+    }
+    printf ("  %-8s %8d %10.2f %10.2f %10.2f %10.2f %10.2f\n", st->name, st->count,
+            st->count ? sum / st->count * 1e6 : 0, percentile (st, 50) * 1e6, percentile (st, 95) * 1e6,
+            percentile (st, 99) * 1e6, percentile (st, 100) * 1e6);
+}
+
+static int
+run (const scenario_t *sc, int width, int height, double duration, int block, int json)
+{
+    wav_t wav;
+    scenario_t s = *sc;
+    if (s.source == SOURCE_WAV) {
+        if (wav_open (&wav, s.path) < 0) {
+            fprintf (stderr, "%s: can't read wav file\n", s.path);
+            return -1;
+        }
+        s.channels = wav.channels;
+        s.samplerate = wav.samplerate;
+        if (wav.frames < 1) {
+            wav_close (&wav);
+            return -1;
+        }
+    }
+
+    stage_t stages[STAGE_COUNT] = {
+        { .name = "ingest" },
+        { .name = "analyze" },
+        { .name = "render" },
+        { .name = "blit" },
+    };
+    bench_widget_t w = { .stages = stages };
+    w.core = sp_core_new ();
+    if (!w.core) {
+        return -1;
+    }
+    bench_apply_config (w.core);
+    deadbeef->vis_waveform_listen (&w, bench_listener);
+
+    // steady state only, don't measure with the interim FFTW_ESTIMATE plan
+    while (sp_core_planning (w.core)) {
+        usleep (1000);
+    }
+
+    cairo_surface_t *surf = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+    cairo_surface_t *target = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+    cairo_t *cr = cairo_create (target);
+    int cursor = 0;
+
+    const int max_block = block > 0 ? block : 4096;
+    float *buf = malloc (sizeof (float) * max_block * s.channels);
+    ddb_waveformat_t fmt = {
+        .bps = 32,
+        .channels = s.channels,
+        .samplerate = s.samplerate,
+        .channelmask = s.channels >= 32 ? 0xffffffffu : (1u << s.channels) - 1,
+        .is_float = 1,
+    };
+
+    // draw once per refresh interval of audio time, like the widget's timer
+    const int64_t total = (int64_t)(duration * s.samplerate);
+    const int64_t tick = (int64_t)s.samplerate * deadbeef->conf_get_int ("spectrogram.refresh_interval", 25) / 1000;
+    int64_t pos = 0;
+    int64_t next_tick = tick;
+    int ticks = 0;
+    int columns = 0;
+    double busy = 0;
+
+    while (pos < total) {
+        // DeaDBeeF hands out blocks of varying length
+        int nframes = block > 0 ? block : 256 + (int)((noise () * 0.5f + 0.5f) * (max_block - 256));
+        if (nframes > total - pos) {
+            nframes = (int)(total - pos);
+        }
+        if (s.source == SOURCE_WAV) {
+            int n = wav_read (&wav, buf, nframes);
+            if (n <= 0) {
+                wav_rewind (&wav);
+                n = wav_read (&wav, buf, nframes);
+            }
+            nframes = n;
+        }
+        else {
+            synthesize (&s, buf, nframes, pos, duration);
+        }
+
+        ddb_audio_data_t data = {
+            .fmt = &fmt,
+            .data = buf,
+            .nframes = nframes,
+        };
+        double t0 = now ();
+        listener_cb (listener_ctx, &data);
+        double t1 = now ();
+        if (w.counting) {
+            stage_add (&stages[STAGE_INGEST], t1 - t0);
+            busy += t1 - t0;
+        }
+        pos += nframes;
+
+        while (pos >= next_tick) {
+            next_tick += tick;
+            w.counting = ++ticks > WARMUP_TICKS;
+            // the widget analyzes on its worker thread, here it runs inline
+            // so that its cost can be attributed
+            t0 = now ();
+            sp_core_analyze (w.core);
+            t1 = now ();
+            int c = bench_draw (&w, surf, &cursor, cr, width, height);
+            double t2 = now ();
+            if (w.counting) {
+                stage_add (&stages[STAGE_ANALYZE], t1 - t0);
+                columns += c;
+                busy += t2 - t0;
+            }
+        }
+    }
+
+    double counted = (double)total - (double)WARMUP_TICKS * tick;
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        qsort (stages[i].samples, stages[i].count, sizeof (double), cmp_double);
+    }
+    if (json) {
+        printf ("{\"source\":\"%s\",\"channels\":%d,\"samplerate\":%d,\"width\":%d,\"height\":%d,"
+                "\"frames_per_s\":%.0f,\"columns_per_s\":%.1f",
+                s.source == SOURCE_WAV ? s.path : source_names[s.source], s.channels, s.samplerate, width, height,
+                counted / busy, columns / busy);
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            printf (",\"%s\":{\"p50_us\":%.2f,\"p95_us\":%.2f,\"p99_us\":%.2f,\"max_us\":%.2f}", stages[i].name,
+                    percentile (&stages[i], 50) * 1e6, percentile (&stages[i], 95) * 1e6,
+                    percentile (&stages[i], 99) * 1e6, percentile (&stages[i], 100) * 1e6);
+        }
+        printf ("}\n");
+    }
+    else {
+        printf ("%s, %d ch, %d Hz, %dx%d\n", s.source == SOURCE_WAV ? s.path : source_names[s.source],
+                s.channels, s.samplerate, width, height);
+        printf ("  %-8s %8s %10s %10s %10s %10s %10s\n", "stage", "calls", "avg us", "p50 us", "p95 us", "p99 us", "max us");
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            print_stage (&stages[i]);
+        }
+        printf ("  %.0f frames/s (%.1fx realtime), %d columns, %.1f columns/s\n\n",
+                counted / busy, counted / busy / s.samplerate, columns, columns / busy);
+    }
+
+    deadbeef->vis_waveform_unlisten (&w);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        free (stages[i].samples);
+    }
+    free (buf);
+    cairo_destroy (cr);
+    cairo_surface_destroy (target);
+    cairo_surface_destroy (surf);
+    sp_core_free (w.core);
+    if (s.source == SOURCE_WAV) {
+        wav_close (&wav);
+    }
+    return 0;
+}
+
+static void
+usage (const char *prog)
+{
+    fprintf (stderr,
+            "Usage: %s [options] [file.wav ...]\n"
+            "  -S sine|noise|sweep  synthetic source (default: a mix of all three)\n"
+            "  -c CHANNELS          channels of the synthetic source\n"
+            "  -r SAMPLERATE        samplerate of the synthetic source\n"
+            "  -s WIDTHxHEIGHT      widget size, may be repeated (default 400x200 and 1920x1080)\n"
+            "  -t SECONDS           audio per run (default 20)\n"
+            "  -b FRAMES            fixed block size (default: random 256..4096)\n"
+            "  -o KEY=VALUE         config override, e.g. -o spectrogram.fft_size=16384\n"
+            "  -j                   one JSON object per run\n",
+            prog);
+}
+
+int
+main (int argc, char **argv)
+{
+    bench_size_t sizes[MAX_SIZES];
+    int num_sizes = 0;
+    scenario_t scenarios[MAX_SCENARIOS];
+    int num_scenarios = 0;
+    int source = -1;
+    int channels = 2;
+    int samplerate = 44100;
+    double duration = 20;
+    int block = 0;
+    int json = 0;
+
+    stub_api.conf_get_int = stub_conf_get_int;
+    stub_api.vis_waveform_listen = stub_vis_waveform_listen;
+    stub_api.vis_waveform_unlisten = stub_vis_waveform_unlisten;
+
+    int opt;
+    while ((opt = getopt (argc, argv, "S:c:r:s:t:b:o:jh")) != -1) {
+        switch (opt) {
+        case 'S':
+            for (source = 0; source < SOURCE_WAV; source++) {
+                if (!strcmp (optarg, source_names[source])) {
+                    break;
+                }
+            }
+            if (source == SOURCE_WAV) {
+                usage (argv[0]);
+                return 1;
+            }
+            break;
+        case 'c':
+            channels = atoi (optarg);
+            break;
+        case 'r':
+            samplerate = atoi (optarg);
+            break;
+        case 's':
+            if (num_sizes < MAX_SIZES && sscanf (optarg, "%dx%d", &sizes[num_sizes].width, &sizes[num_sizes].height) == 2
+                    && sizes[num_sizes].width > 0 && sizes[num_sizes].height > 1) {
+                num_sizes++;
+            }
+            break;
+        case 't':
+            duration = atof (optarg);
+            break;
+        case 'b':
+            block = atoi (optarg);
+            break;
+        case 'o': {
+            char *eq = strchr (optarg, '=');
+            if (eq && num_overrides < MAX_OVERRIDES) {
+                *eq = 0;
+                overrides[num_overrides].key = optarg;
+                overrides[num_overrides].value = atoi (eq + 1);
+                num_overrides++;
+            }
+            break;
+        }
+        case 'j':
+            json = 1;
+            break;
+        default:
+            usage (argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (channels < 1 || channels > 32 || samplerate < 8000 || duration <= 0) {
+        usage (argv[0]);
+        return 1;
+    }
+
+    for (int i = optind; i < argc && num_scenarios < MAX_SCENARIOS; i++) {
+        scenarios[num_scenarios++] = (scenario_t){ SOURCE_WAV, 0, 0, argv[i] };
+    }
+    if (source >= 0) {
+        scenarios[num_scenarios++] = (scenario_t){ source, channels, samplerate, NULL };
+    }
+    else if (num_scenarios == 0) {
+        // mono, stereo and multichannel input at the common samplerates
+        scenarios[num_scenarios++] = (scenario_t){ SOURCE_SINE, 2, 44100, NULL };
+        scenarios[num_scenarios++] = (scenario_t){ SOURCE_NOISE, 1, 48000, NULL };
+        scenarios[num_scenarios++] = (scenario_t){ SOURCE_SWEEP, 6, 96000, NULL };
+    }
+    if (num_sizes == 0) {
+        sizes[num_sizes++] = (bench_size_t){ 400, 200 };
+        sizes[num_sizes++] = (bench_size_t){ 1920, 1080 };
+    }
+
+    int res = 0;
+    for (int i = 0; i < num_scenarios; i++) {
+        for (int j = 0; j < num_sizes; j++) {
+            if (run (&scenarios[i], sizes[j].width, sizes[j].height, duration, block, json) < 0) {
+                res = 1;
+            }
+        }
+    }
+    return res;
+}
@@ -0,0 +1,537 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Offline whole-track spectrogram renderer. Reads a WAV or raw PCM file
+    and writes a PNG with one column per output pixel, computed by the same
+    engine code as the widget: packed stereo FFT, row mapping and color
+    kernel, left channel on top and right channel at the bottom.
+
+    Columns are independent, so they are spread over a pool of worker
+    threads. Every worker starts out with a contiguous range of columns
+    and, once that is used up, steals the upper half of the largest range
+    left among the others.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <cairo.h>
+
+#include "sp_core.h"
+#include "sp_decimator.h"
+#include "wav.h"
+
+// columns taken from the own range at once
+#define CHUNK 4
+
+typedef struct job_s job_t;
+
+typedef struct {
+    job_t *job;
+    int index;
+    pthread_t thread;
+    sp_core_t *core;
+    float *window;
+    // columns [next, end) not started yet, stolen from the top
+    pthread_mutex_t mutex;
+    int next;
+    int end;
+    int columns;
+} worker_t;
+
+struct job_s {
+    // at most SP_MAX_CHANNELS channels of the input, interleaved
+    const float *audio;
+    int64_t frames;
+    int channels;
+    int samplerate;
+    int fft_size;
+    int width;
+    int height;
+    uint8_t *data;
+    int stride;
+    worker_t *workers;
+    int num_workers;
+};
+
+typedef struct {
+    sp_config_t conf;
+    sp_color_t colors[SP_MAX_COLORS];
+    int num_colors;
+} settings_t;
+
+static double
+now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Plugin defaults, see load_config in spectrogram.c
+static void
+settings_init (settings_t *st)
+{
+    static const sp_color_t colors[SP_MAX_COLORS] = {
+        { 65535, 0, 0 },
+        { 65535, 32896, 0 },
+        { 65535, 65535, 0 },
+        { 32896, 65535, 30840 },
+        { 0, 38036, 41120 },
+        { 0, 8224, 25700 },
+        { 0, 0, 0 },
+    };
+    memset (st, 0, sizeof (settings_t));
+    memcpy (st->colors, colors, sizeof (colors));
+    st->num_colors = SP_MAX_COLORS;
+    st->conf.log_scale = 1;
+    st->conf.db_range = 70;
+    st->conf.refresh_interval = 25;
+    st->conf.hop_size = 1024;
+    st->conf.fft_size = SP_DEFAULT_FFT_SIZE;
+    st->conf.window = SP_WINDOW_BLACKMAN_HARRIS;
+    st->conf.planner = SP_PLANNER_MEASURE;
+}
+
+// Pick up the widget settings from a DeaDBeeF config file, so that the
+// images look exactly like the widget
+static int
+settings_load (settings_t *st, const char *path)
+{
+    FILE *fp = fopen (path, "r");
+    if (!fp) {
+        return -1;
+    }
+    char line[1024];
+    while (fgets (line, sizeof (line), fp)) {
+        char key[256];
+        int value;
+        unsigned short r, g, b;
+        int idx;
+        if (sscanf (line, "spectrogram.color.gradient_%d %hu %hu %hu", &idx, &r, &g, &b) == 4) {
+            if (idx >= 0 && idx < SP_MAX_COLORS) {
+                st->colors[idx] = (sp_color_t){ r, g, b };
+            }
+            continue;
+        }
+        char list[256];
+        if (sscanf (line, "spectrogram.channels %255s", list) == 1) {
+            st->conf.channel_mask = sp_core_channel_mask (list);
+            continue;
+        }
+        if (sscanf (line, "%255s %d", key, &value) != 2) {
+            continue;
+        }
+        if (!strcmp (key, "spectrogram.log_scale")) st->conf.log_scale = value;
+        else if (!strcmp (key, "spectrogram.db_range")) st->conf.db_range = value;
+        else if (!strcmp (key, "spectrogram.fft_size")) st->conf.fft_size = value;
+        else if (!strcmp (key, "spectrogram.window")) st->conf.window = value;
+        else if (!strcmp (key, "spectrogram.multires")) st->conf.multires = value;
+        else if (!strcmp (key, "spectrogram.max_bandwidth")) st->conf.max_bandwidth = value;
+        else if (!strcmp (key, "spectrogram.num_colors")) st->num_colors = value;
+    }
+    fclose (fp);
+    if (st->num_colors < 1 || st->num_colors > SP_MAX_COLORS) {
+        st->num_colors = SP_MAX_COLORS;
+    }
+    return 0;
+}
+
+static sp_core_t *
+core_new (const settings_t *st)
+{
+    sp_core_t *core = sp_core_new ();
+    if (!core) {
+        return NULL;
+    }
+    sp_core_set_gradient (core, st->colors, st->num_colors);
+    sp_core_set_config (core, &st->conf);
+    while (sp_core_planning (core)) {
+        usleep (1000);
+    }
+    return core;
+}
+
+// Window of fft_size frames centered on column x, zero padded at both ends
+static void
+fill_window (const job_t *job, int x, float *window)
+{
+    const int ch = job->channels;
+    int64_t center = (int64_t)((x + 0.5) * job->frames / job->width);
+    int64_t start = center - job->fft_size/2;
+    int64_t end = start + job->fft_size;
+
+    int64_t from = start < 0 ? 0 : start;
+    int64_t to = end > job->frames ? job->frames : end;
+    float *out = window;
+    if (from > start) {
+        memset (out, 0, sizeof (float) * (from - start) * ch);
+        out += (from - start) * ch;
+    }
+    if (to > from) {
+        memcpy (out, job->audio + from * ch, sizeof (float) * (to - from) * ch);
+        out += (to - from) * ch;
+    }
+    if (end > to) {
+        memset (out, 0, sizeof (float) * (end - (to > from ? to : from)) * ch);
+    }
+}
+
+// Next chunk from the own range, [*x0, *x1)
+static int
+take_own (worker_t *w, int *x0, int *x1)
+{
+    pthread_mutex_lock (&w->mutex);
+    int n = w->end - w->next;
+    if (n > CHUNK) {
+        n = CHUNK;
+    }
+    *x0 = w->next;
+    *x1 = w->next + n;
+    w->next += n;
+    pthread_mutex_unlock (&w->mutex);
+    return n > 0;
+}
+
+// Move the upper half of the largest remaining range over to w
+static int
+steal (worker_t *w)
+{
+    job_t *job = w->job;
+    for (;;) {
+        worker_t *victim = NULL;
+        int most = 0;
+        for (int i = 0; i < job->num_workers; i++) {
+            worker_t *v = &job->workers[i];
+            int n = __atomic_load_n (&v->end, __ATOMIC_RELAXED) - __atomic_load_n (&v->next, __ATOMIC_RELAXED);
+            if (v != w && n > most) {
+                most = n;
+                victim = v;
+            }
+        }
+        if (!victim) {
+            return 0;
+        }
+
+        int x0 = 0, x1 = 0;
+        pthread_mutex_lock (&victim->mutex);
+        int n = victim->end - victim->next;
+        if (n > 0) {
+            x1 = victim->end;
+            x0 = victim->end - (n + 1) / 2;
+            victim->end = x0;
+        }
+        pthread_mutex_unlock (&victim->mutex);
+        if (x1 > x0) {
+            pthread_mutex_lock (&w->mutex);
+            w->next = x0;
+            w->end = x1;
+            pthread_mutex_unlock (&w->mutex);
+            return 1;
+        }
+        // somebody else was faster, look again
+    }
+}
+
+static void *
+worker_thread (void *ctx)
+{
+    worker_t *w = ctx;
+    job_t *job = w->job;
+    for (;;) {
+        int x0, x1;
+        if (!take_own (w, &x0, &x1)) {
+            if (!steal (w)) {
+                break;
+            }
+            continue;
+        }
+        for (int x = x0; x < x1; x++) {
+            fill_window (job, x, w->window);
+            sp_core_render_frames (w->core, w->window, job->channels, job->samplerate, job->data, job->stride, x, job->height);
+            w->columns++;
+        }
+    }
+    return NULL;
+}
+
+// Whole file as interleaved float, the first SP_MAX_CHANNELS channels are
+// kept; sp_core_render_frames picks the configured ones from those
+static float *
+read_audio (wav_t *wav, int bandwidth, int64_t *frames, int *channels, int *samplerate)
+{
+    // decimated like sp_core_ingest does
+    sp_decimator_t *dec = malloc (sizeof (sp_decimator_t));
+    if (!dec) {
+        return NULL;
+    }
+    sp_decimator_setup (dec, sp_decimator_factor (wav->samplerate, bandwidth));
+    const int ch = wav->channels < SP_MAX_CHANNELS ? wav->channels : SP_MAX_CHANNELS;
+    int map[SP_MAX_CHANNELS];
+    for (int c = 0; c < ch; c++) {
+        map[c] = c;
+    }
+    const int64_t max_frames = wav->frames / dec->factor + 1;
+    float *audio = malloc (sizeof (float) * max_frames * ch);
+    float *block = malloc (sizeof (float) * SP_DECIMATOR_CHUNK * wav->channels);
+    float *out = malloc (sizeof (float) * SP_DECIMATOR_CHUNK * ch);
+    if (!audio || !block || !out) {
+        free (dec);
+        free (audio);
+        free (block);
+        free (out);
+        return NULL;
+    }
+    int64_t pos = 0;
+    int n;
+    while ((n = wav_read (wav, block, SP_DECIMATOR_CHUNK)) > 0) {
+        const float *src = block;
+        int src_ch = wav->channels;
+        if (dec->factor > 1) {
+            n = sp_decimator_run (dec, block, n, wav->channels, map, ch, out);
+            src = out;
+            src_ch = ch;
+        }
+        if (n > max_frames - pos) {
+            n = (int)(max_frames - pos);
+        }
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < ch; c++) {
+                audio[(pos + i) * ch + c] = src[i * src_ch + c];
+            }
+        }
+        pos += n;
+    }
+    *frames = pos;
+    *channels = ch;
+    *samplerate = wav->samplerate / dec->factor;
+    free (dec);
+    free (block);
+    free (out);
+    return audio;
+}
+
+static void
+usage (const char *prog)
+{
+    fprintf (stderr,
+            "Usage: %s [options] -o out.png input\n"
+            "  -o FILE        output PNG\n"
+            "  -W WIDTH       image width, one column per pixel (default 1920)\n"
+            "  -H HEIGHT      image height, one lane per channel (default 540)\n"
+            "  -C FILE        take the widget settings from a DeaDBeeF config file\n"
+            "  -s FFT_SIZE    FFT size\n"
+            "  -w WINDOW      0 Blackman-Harris, 1 Hann, 2 Kaiser, 3 flat top\n"
+            "  -d DB_RANGE    dB range\n"
+            "  -l 0|1         linear or log frequency scale\n"
+            "  -m 0|1         multi-resolution analysis (log scale only)\n"
+            "  -b HZ          highest frequency analyzed, decimates the input\n"
+            "  -n CHANNELS    channels to draw, e.g. 1,2,5 (default all)\n"
+            "  -L LANES       0 L/R, 1 M/S, 2 L/R + correlation\n"
+            "  -j THREADS     worker threads (default: all cores)\n"
+            "  -f FORMAT      raw PCM input: s8 s16 s24 s32 f32 f64, little endian\n"
+            "  -c CHANNELS    channels of raw input (default 2)\n"
+            "  -r SAMPLERATE  samplerate of raw input (default 44100)\n"
+            "  -v             print timings\n",
+            prog);
+}
+
+int
+main (int argc, char **argv)
+{
+    settings_t st;
+    settings_init (&st);
+    const char *out_path = NULL;
+    const char *raw_format = NULL;
+    int raw_channels = 2;
+    int raw_samplerate = 44100;
+    int width = 1920;
+    int height = 540;
+    int threads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+    int verbose = 0;
+    // command line options override the config file, wherever they appear
+    int opt_fft = -1, opt_window = -1, opt_db = -1, opt_log = -1, opt_multires = -1, opt_bandwidth = -1;
+    const char *opt_channels = NULL;
+
+    int opt;
+    while ((opt = getopt (argc, argv, "o:W:H:C:s:w:d:l:m:b:n:L:j:f:c:r:vh")) != -1) {
+        switch (opt) {
+        case 'o': out_path = optarg; break;
+        case 'W': width = atoi (optarg); break;
+        case 'H': height = atoi (optarg); break;
+        case 'C':
+            if (settings_load (&st, optarg) < 0) {
+                fprintf (stderr, "%s: can't read config\n", optarg);
+                return 1;
+            }
+            break;
+        case 's': opt_fft = atoi (optarg); break;
+        case 'w': opt_window = atoi (optarg); break;
+        case 'd': opt_db = atoi (optarg); break;
+        case 'l': opt_log = atoi (optarg); break;
+        case 'm': opt_multires = atoi (optarg); break;
+        case 'b': opt_bandwidth = atoi (optarg); break;
+        case 'n': opt_channels = optarg; break;
+        case 'L': st.conf.lane_mode = atoi (optarg); break;
+        case 'j': threads = atoi (optarg); break;
+        case 'f': raw_format = optarg; break;
+        case 'c': raw_channels = atoi (optarg); break;
+        case 'r': raw_samplerate = atoi (optarg); break;
+        case 'v': verbose = 1; break;
+        default:
+            usage (argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!out_path || optind != argc - 1 || width < 1 || height < 2) {
+        usage (argv[0]);
+        return 1;
+    }
+    if (opt_fft > 0) st.conf.fft_size = opt_fft;
+    if (opt_window >= 0) st.conf.window = opt_window;
+    if (opt_db > 0) st.conf.db_range = opt_db;
+    if (opt_log >= 0) st.conf.log_scale = opt_log;
+    if (opt_multires >= 0) st.conf.multires = opt_multires;
+    if (opt_bandwidth >= 0) st.conf.max_bandwidth = opt_bandwidth;
+    if (opt_channels) st.conf.channel_mask = sp_core_channel_mask (opt_channels);
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    // Share FFTW wisdom with the plugin if it has been used before
+    const char *xdg = getenv ("XDG_CACHE_HOME");
+    const char *home = getenv ("HOME");
+    char cache_dir[4096];
+    struct stat sb;
+    if (xdg && *xdg) {
+        snprintf (cache_dir, sizeof (cache_dir), "%s/deadbeef/stereo_spectrogram", xdg);
+    }
+    else {
+        snprintf (cache_dir, sizeof (cache_dir), "%s/.cache/deadbeef/stereo_spectrogram", home ? home : ".");
+    }
+    if (stat (cache_dir, &sb) == 0 && S_ISDIR (sb.st_mode)) {
+        sp_core_set_cache_dir (cache_dir);
+    }
+
+    double t_start = now ();
+    wav_t wav;
+    int res;
+    if (raw_format) {
+        static const struct { const char *name; int bits; int is_float; } formats[] = {
+            { "s8", 8, 0 }, { "s16", 16, 0 }, { "s24", 24, 0 }, { "s32", 32, 0 }, { "f32", 32, 1 }, { "f64", 64, 1 },
+        };
+        res = -1;
+        for (size_t i = 0; i < sizeof (formats) / sizeof (formats[0]); i++) {
+            if (!strcmp (raw_format, formats[i].name)) {
+                res = wav_open_raw (&wav, argv[optind], formats[i].bits, formats[i].is_float, raw_channels, raw_samplerate);
+                break;
+            }
+        }
+    }
+    else {
+        res = wav_open (&wav, argv[optind]);
+    }
+    if (res < 0) {
+        fprintf (stderr, "%s: can't read audio\n", argv[optind]);
+        return 1;
+    }
+
+    job_t job;
+    memset (&job, 0, sizeof (job));
+    job.audio = read_audio (&wav, st.conf.max_bandwidth, &job.frames, &job.channels, &job.samplerate);
+    wav_close (&wav);
+    if (!job.audio) {
+        fprintf (stderr, "out of memory\n");
+        return 1;
+    }
+    double t_read = now ();
+
+    cairo_surface_t *surf = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+    cairo_surface_flush (surf);
+    job.data = cairo_image_surface_get_data (surf);
+    job.stride = cairo_image_surface_get_stride (surf);
+    job.width = width;
+    job.height = height;
+
+    // The first core plans (and measures) the FFT, the others find the
+    // plan in FFTW's wisdom
+    if (threads > width) {
+        threads = width;
+    }
+    job.workers = calloc (threads, sizeof (worker_t));
+    job.num_workers = threads;
+    for (int i = 0; i < threads; i++) {
+        worker_t *w = &job.workers[i];
+        w->job = &job;
+        w->index = i;
+        w->core = core_new (&st);
+        if (!w->core || !sp_core_window_size (w->core)) {
+            fprintf (stderr, "can't set up the analysis\n");
+            return 1;
+        }
+        job.fft_size = sp_core_window_size (w->core);
+        w->window = malloc (sizeof (float) * job.fft_size * job.channels);
+        pthread_mutex_init (&w->mutex, NULL);
+        w->next = (int)((int64_t)width * i / threads);
+        w->end = (int)((int64_t)width * (i + 1) / threads);
+    }
+    double t_plan = now ();
+
+    for (int i = 0; i < threads; i++) {
+        pthread_create (&job.workers[i].thread, NULL, worker_thread, &job.workers[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join (job.workers[i].thread, NULL);
+    }
+    cairo_surface_mark_dirty (surf);
+    double t_render = now ();
+
+    res = cairo_surface_write_to_png (surf, out_path) == CAIRO_STATUS_SUCCESS ? 0 : 1;
+    if (res) {
+        fprintf (stderr, "%s: can't write png\n", out_path);
+    }
+    double t_end = now ();
+
+    if (verbose) {
+        fprintf (stderr, "%lld frames, %d Hz, fft %d, %dx%d, %d threads\n", (long long)job.frames, job.samplerate,
+                job.fft_size, width, height, threads);
+        fprintf (stderr, "read %.3f s, plan %.3f s, render %.3f s, png %.3f s\n",
+                t_read - t_start, t_plan - t_read, t_render - t_plan, t_end - t_render);
+        for (int i = 0; i < threads; i++) {
+            fprintf (stderr, "  worker %d: %d columns\n", i, job.workers[i].columns);
+        }
+    }
+
+    for (int i = 0; i < threads; i++) {
+        sp_core_free (job.workers[i].core);
+        free (job.workers[i].window);
+        pthread_mutex_destroy (&job.workers[i].mutex);
+    }
+    free (job.workers);
+    free ((float *)job.audio);
+    cairo_surface_destroy (surf);
+    return res;
+}
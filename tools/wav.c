@@ -0,0 +1,202 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wav.h"
+
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+static uint32_t
+le32 (const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t
+le16 (const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+int
+wav_open (wav_t *wav, const char *path)
+{
+    memset (wav, 0, sizeof (wav_t));
+    wav->fp = fopen (path, "rb");
+    if (!wav->fp) {
+        return -1;
+    }
+
+    uint8_t hdr[12];
+    if (fread (hdr, 1, 12, wav->fp) != 12 || memcmp (hdr, "RIFF", 4) || memcmp (hdr + 8, "WAVE", 4)) {
+        goto error;
+    }
+
+    int have_fmt = 0;
+    int format = 0;
+    for (;;) {
+        uint8_t chunk[8];
+        if (fread (chunk, 1, 8, wav->fp) != 8) {
+            goto error;
+        }
+        uint32_t size = le32 (chunk + 4);
+        if (!memcmp (chunk, "fmt ", 4)) {
+            uint8_t fmt[40];
+            if (size < 16 || size > sizeof (fmt) || fread (fmt, 1, size, wav->fp) != size) {
+                goto error;
+            }
+            format = le16 (fmt);
+            wav->channels = le16 (fmt + 2);
+            wav->samplerate = le32 (fmt + 4);
+            wav->bits = le16 (fmt + 14);
+            if (format == WAVE_FORMAT_EXTENSIBLE && size >= 26) {
+                // first two bytes of the subformat GUID hold the actual format
+                format = le16 (fmt + 24);
+            }
+            have_fmt = 1;
+        }
+        else if (!memcmp (chunk, "data", 4)) {
+            if (!have_fmt) {
+                goto error;
+            }
+            wav->data_offset = ftell (wav->fp);
+            wav->frames = size / (wav->channels * (wav->bits / 8));
+            wav->remaining = wav->frames;
+            break;
+        }
+        else if (fseek (wav->fp, size + (size & 1), SEEK_CUR)) {
+            goto error;
+        }
+    }
+
+    wav->is_float = format == WAVE_FORMAT_IEEE_FLOAT;
+    if (wav->channels < 1 || wav->samplerate < 1
+            || (format != WAVE_FORMAT_PCM && format != WAVE_FORMAT_IEEE_FLOAT)
+            || (wav->is_float && wav->bits != 32 && wav->bits != 64)
+            || (!wav->is_float && (wav->bits < 8 || wav->bits > 32 || wav->bits % 8))) {
+        goto error;
+    }
+    return 0;
+
+error:
+    wav_close (wav);
+    return -1;
+}
+
+int
+wav_open_raw (wav_t *wav, const char *path, int bits, int is_float, int channels, int samplerate)
+{
+    memset (wav, 0, sizeof (wav_t));
+    if (channels < 1 || samplerate < 1
+            || (is_float && bits != 32 && bits != 64)
+            || (!is_float && (bits < 8 || bits > 32 || bits % 8))) {
+        return -1;
+    }
+    wav->fp = fopen (path, "rb");
+    if (!wav->fp || fseek (wav->fp, 0, SEEK_END)) {
+        wav_close (wav);
+        return -1;
+    }
+    wav->channels = channels;
+    wav->samplerate = samplerate;
+    wav->bits = bits;
+    wav->is_float = is_float;
+    wav->frames = ftell (wav->fp) / (channels * (bits / 8));
+    wav->remaining = wav->frames;
+    wav->data_offset = 0;
+    fseek (wav->fp, 0, SEEK_SET);
+    return 0;
+}
+
+void
+wav_close (wav_t *wav)
+{
+    if (wav->fp) {
+        fclose (wav->fp);
+    }
+    free (wav->buf);
+    memset (wav, 0, sizeof (wav_t));
+}
+
+int
+wav_rewind (wav_t *wav)
+{
+    wav->remaining = wav->frames;
+    return fseek (wav->fp, wav->data_offset, SEEK_SET);
+}
+
+int
+wav_read (wav_t *wav, float *out, int nframes)
+{
+    if (nframes > wav->remaining) {
+        nframes = (int)wav->remaining;
+    }
+    if (nframes <= 0) {
+        return 0;
+    }
+    const int bytes = wav->bits / 8;
+    const int frame_size = bytes * wav->channels;
+    if (wav->buf_frames < nframes) {
+        free (wav->buf);
+        wav->buf = malloc ((size_t)nframes * frame_size);
+        wav->buf_frames = wav->buf ? nframes : 0;
+        if (!wav->buf) {
+            return 0;
+        }
+    }
+    nframes = (int)fread (wav->buf, frame_size, nframes, wav->fp);
+    wav->remaining -= nframes;
+
+    const int n = nframes * wav->channels;
+    const uint8_t *p = wav->buf;
+    for (int i = 0; i < n; i++, p += bytes) {
+        if (wav->is_float) {
+            if (bytes == 4) {
+                uint32_t v = le32 (p);
+                float f;
+                memcpy (&f, &v, 4);
+                out[i] = f;
+            }
+            else {
+                uint64_t v = le32 (p) | ((uint64_t)le32 (p + 4) << 32);
+                double d;
+                memcpy (&d, &v, 8);
+                out[i] = (float)d;
+            }
+        }
+        else if (bytes == 1) {
+            // 8 bit PCM is unsigned
+            out[i] = (p[0] - 128) / 128.f;
+        }
+        else {
+            // sign extend from the top byte
+            int32_t v = 0;
+            for (int b = 0; b < bytes; b++) {
+                v |= (uint32_t)p[b] << (8 * (4 - bytes + b));
+            }
+            out[i] = v / 2147483648.f;
+        }
+    }
+    return nframes;
+}
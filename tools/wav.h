@@ -0,0 +1,66 @@
+/*
+    Stereo Spectrogram plugin for the DeaDBeeF audio player
+
+    Copyright (C) 2014 Christian Boxdörfer <christian.boxdoerfer@posteo.de>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/*
+    Minimal RIFF/WAVE reader for the command line tools: integer PCM of
+    8 to 32 bits and 32/64 bit float, plain or WAVE_FORMAT_EXTENSIBLE.
+    Headerless little endian PCM in the same formats is read as well.
+*/
+
+#ifndef __WAV_H
+#define __WAV_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef struct {
+    FILE *fp;
+    int channels;
+    int samplerate;
+    int bits;
+    int is_float;
+    int64_t frames;     // total frames in the data chunk
+    int64_t remaining;  // frames left to read
+    long data_offset;
+    uint8_t *buf;
+    int buf_frames;
+} wav_t;
+
+// Returns 0 on success, -1 if the file can't be read or is not supported
+int
+wav_open (wav_t *wav, const char *path);
+
+// Raw PCM, e.g. bits 16 is_float 0 for s16le
+int
+wav_open_raw (wav_t *wav, const char *path, int bits, int is_float, int channels, int samplerate);
+
+void
+wav_close (wav_t *wav);
+
+// Read up to nframes interleaved frames converted to float in [-1, 1].
+// Returns the number of frames read, 0 at the end of the data.
+int
+wav_read (wav_t *wav, float *out, int nframes);
+
+// Start over from the first frame
+int
+wav_rewind (wav_t *wav);
+
+#endif // __WAV_H